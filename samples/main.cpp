@@ -11,6 +11,7 @@
 #include "print.hpp"
 #include "async.hpp"
 #include "ascii.hpp"
+#include "resolution.hpp"
 
 #ifdef COPPER_INCLUDE_EXT
 #   include "ext/gui.hpp"
@@ -96,6 +97,7 @@ int main() {
         .frame = fb,
         .viewport = {0, ext.y, ext.x, -ext.y},
         .cullFace = cu::CullFace::none,
+        .shading_rate = cu::ShadingRate::x4, // a glyph covers 5x10 pixels
         .enable_blend = true
     }};
 
@@ -111,33 +113,45 @@ int main() {
         v[i].attr.var.color[i] = 1.f;
     }
 
-    auto vai = va.getVertices(ig);
+    auto mesh = cu::weld(va, ig);
 
     cu::Extent term_ext{160, 50};
-    [[maybe_unused]] cu::Printer pr{term_ext};
+    [[maybe_unused]] cu::DeltaPrinter pr{term_ext};
 
     cu::AsciiFactory ascii;
     ascii.set_noise_enable(true);
+    ascii.set_downsample(cu::Downsample::area);
+    std::string frame;
+
+    cu::FramePacer pacer{60};
+    pacer.set_skip_late(true);
+    pacer.set_adaptive(true);
+    cu::DynamicResolution dynres{pipe.get_viewport()};
 
     int n = 0;
     while (n < INT_MAX) {
-        auto f = cu::FLatch{std::chrono::milliseconds{16}};
+        dynres.apply(pipe, pacer.render_scale());
+        ascii.set_source_rect(dynres.rect());
+        pipe.clear_color({.5f, .5f, .5f, 1.f}, dynres.rect());
 
         uni->matrix["model"] = cu::translate(cu::vec3{0, 0, -3.f}) * cu::rotate<float>(cu::EulerAngle{M_PI*n/180, M_PI*n/150, M_PI*n/210}, cu::xyz);
-        pipe.draw_array(vai, cu::Topology::triangle);
+        pipe.draw_mesh(mesh, cu::Topology::triangle);
 //        pipe.finish();
 
         cam->position.z = sinf(M_PI*n/180)*2.f;
 
-        pr << ascii.process(tex, pr.viewport);
+        if (pacer.should_present()) {
+            ascii.process_into(tex, pr.viewport, frame);
+            pr << frame;
+        }
 
-        fb.color_image->clear({.5f, .5f, .5f, 1.f});
         pr.clear();
 
 //        gui->show();
 //        gui->clear({.5f, .5f, .5f, 1.f});
 
         n++;
+        pacer.wait();
     }
 
     return 0;
@@ -0,0 +1,50 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include "mesh_io.hpp"
+#include "optimize.hpp"
+
+// objconv input.obj output.mesh [-O]
+// -O reorders for the vertex cache, overdraw and vertex fetch
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " input.obj output.mesh [-O]\n";
+        return 1;
+    }
+    bool optimize = argc > 3 && std::strcmp(argv[3], "-O") == 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto workers = std::max(std::thread::hardware_concurrency(), 1u);
+    st::ThreadPool pool{workers};
+    auto mesh = cu::load_obj(argv[1], &pool, (int)workers);
+    if (!mesh) {
+        std::cerr << "failed to read " << argv[1] << '\n';
+        return 1;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (optimize) {
+        cu::optimize_vertex_cache(*mesh);
+        cu::optimize_overdraw(*mesh);
+        cu::optimize_vertex_fetch(*mesh);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    if (!cu::save_mesh(argv[2], *mesh)) {
+        std::cerr << "failed to write " << argv[2] << '\n';
+        return 1;
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::cout << mesh->vertex_count() << " vertices, " << mesh->index_count() / 3 << " triangles\n"
+              << "parse " << ms(t1 - t0) << " ms, optimize " << ms(t2 - t1) << " ms, write " << ms(t3 - t2) << " ms\n";
+    return 0;
+}
@@ -0,0 +1,82 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include <cstring>
+#include <iostream>
+
+#include "pipeline.hpp"
+
+// renders the demo cube with and without the depth prepass and compares the frames
+// returns non-zero if any pixel differs
+int main() {
+    constexpr cu::Extent ext{200, 125};
+
+    cu::VertexArray va {
+        .positions = {{1, 1, 1}, {1, -1, 1}, {1, -1, -1}, {1, 1, -1}, {-1, 1, 1}, {-1, -1, 1}, {-1, -1, -1}, {-1, 1, -1}},
+        .colors = {{1, 1, 1, 1}, {1, 0, 1, 1}, {1, 0, 0, 1}, {1, 1, 0, 1}, {0, 1, 1, 1}, {0, 0, 1, 1}, {0, 0, 0, 1}, {0, 1, 0, 1}}
+    };
+    std::vector<cu::IndexGroup> ig;
+    for (uint32_t i : {0, 1, 3, 1, 2, 3, 4, 7, 5, 7, 6, 5, 4, 0, 7, 0, 3, 7, 1, 5, 2, 5, 6, 2, 4, 5, 0, 5, 1, 0, 3, 2, 7, 2, 6, 7})
+        ig.push_back({.pos = i, .col = i});
+    auto mesh = cu::weld(va, ig);
+
+    auto color = std::make_shared<cu::ImageRGBA8>(ext);
+    cu::FrameBuffer fb{.color_image = color, .depth_image = std::make_shared<cu::ImageF32>(ext)};
+    auto cam = std::make_shared<cu::Camera>(cu::Frustum{.1f, (float)ext.x / ext.y, cu::radians(60.f)}, cu::vec3{0.f});
+    auto uni = std::make_shared<cu::Uniform>();
+
+    auto vs = [](auto&& v, auto&& uni, auto&& cam) -> cu::vec4 {
+        return cam.proj_view() * uni.matrix.at("model") * cu::vec4{v.pos, 1.f};
+    };
+    // the demo shader, it discards the corners of the cube
+    auto discard = [](auto&& v, auto&&, auto&&) -> std::optional<cu::Color> {
+        auto color = v.get_attr().var.color;
+        cu::vec3 pos = color;
+        pos = pos * 2 - 1;
+        if (pos.length_squared() > 1.64f)
+            return std::nullopt;
+        return color;
+    };
+    auto opaque = [](auto&& v, auto&&, auto&&) -> std::optional<cu::Color> {
+        return v.get_attr().var.color;
+    };
+
+    cu::Pipeline pipe = {{
+        .camera = cam,
+        .vertexShader = vs,
+        .fragmentShader = discard,
+        .uniform = uni,
+        .frame = fb,
+        .viewport = {0, ext.y, ext.x, -ext.y},
+        .enable_depth_test = true,
+        .enable_depth_write = true
+    }};
+
+    auto render = [&](int n, bool prepass, bool is_opaque) {
+        uni->matrix["model"] = cu::translate(cu::vec3{0, 0, -3.f}) * cu::rotate<float>(cu::EulerAngle{M_PI*n/180, M_PI*n/150, M_PI*n/210}, cu::xyz);
+        color->clear({.5f, .5f, .5f, 1.f});
+        pipe.clear_depth();
+        auto draw = [&] { pipe.draw_mesh(mesh, cu::Topology::triangle); };
+        if (prepass) pipe.draw_with_depth_prepass(draw, is_opaque);
+        else draw();
+        return std::vector<cu::ColorU32>(color->data_, color->data_ + ext.x * ext.y);
+    };
+
+    int failed = 0;
+    for (bool is_opaque : {false, true}) {
+        pipe.set_fragment_shader(is_opaque ? cu::FragmentShader(opaque) : cu::FragmentShader(discard));
+        for (int n = 0; n < 360; n += 15) {
+            auto a = render(n, false, is_opaque), b = render(n, true, is_opaque);
+            int diff = 0;
+            for (size_t i = 0; i < a.size(); i++)
+                diff += std::memcmp(&a[i], &b[i], sizeof(cu::ColorU32)) != 0;
+            if (diff) {
+                std::cout << (is_opaque ? "opaque" : "discard") << " frame " << n << ": " << diff << " pixels differ\n";
+                ++failed;
+            }
+        }
+    }
+    std::cout << (failed ? "prepass check failed\n" : "prepass check passed\n");
+    return failed != 0;
+}
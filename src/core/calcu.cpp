@@ -62,4 +62,68 @@ Attribute Attribute::operator/(float k) const {
     return *this * (1.f / k);
 }
 
-}
\ No newline at end of file
+#ifdef CU_ENABLED_SIMD
+namespace {
+
+inline __m128i mm_pack_to_i32(__m128 c) {
+    auto v = _mm_mul_ps(c, _mm_set1_ps(255.f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.f)); // NaN goes to 0
+    return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(.5f))); // round half up
+}
+
+inline __m128 mm_unpack_from_u8(__m128i c) {
+    auto i = _mm_unpacklo_epi16(_mm_unpacklo_epi8(c, _mm_setzero_si128()), _mm_setzero_si128());
+    return _mm_div_ps(_mm_cvtepi32_ps(i), _mm_set1_ps(255.f));
+}
+
+}
+#endif
+
+ColorU32 pack_color(const Color& color) {
+#ifndef CU_ENABLED_SIMD
+    return color;
+#else
+    auto i = mm_pack_to_i32(_mm_loadu_ps(color.value_ptr()));
+    i = _mm_packs_epi32(i, i);
+    i = _mm_packus_epi16(i, i);
+    return std::bit_cast<ColorU32>(_mm_cvtsi128_si32(i));
+#endif
+}
+
+Color unpack_color(ColorU32 color) {
+#ifndef CU_ENABLED_SIMD
+    return Color(color) / 255.f;
+#else
+    Color r;
+    _mm_storeu_ps(r.value_ptr(), mm_unpack_from_u8(_mm_cvtsi32_si128(std::bit_cast<int>(color))));
+    return r;
+#endif
+}
+
+void pack_colors(std::span<const Color> src, ColorU32* dst) {
+    size_t i = 0;
+#ifdef CU_ENABLED_SIMD
+    for (; i + 4 <= src.size(); i += 4) {
+        auto a = _mm_packs_epi32(mm_pack_to_i32(_mm_loadu_ps(src[i].value_ptr())),
+                                 mm_pack_to_i32(_mm_loadu_ps(src[i+1].value_ptr())));
+        auto b = _mm_packs_epi32(mm_pack_to_i32(_mm_loadu_ps(src[i+2].value_ptr())),
+                                 mm_pack_to_i32(_mm_loadu_ps(src[i+3].value_ptr())));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+    }
+#endif
+    for (; i < src.size(); i++)
+        dst[i] = pack_color(src[i]);
+}
+
+void fill_colors(ColorU32* dst, size_t n, ColorU32 color) {
+    size_t i = 0;
+#ifdef CU_ENABLED_SIMD
+    auto c = _mm_set1_epi32(std::bit_cast<int>(color));
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), c);
+#endif
+    for (; i < n; i++)
+        dst[i] = color;
+}
+
+}
@@ -5,6 +5,9 @@
 #pragma once
 
 #include "mathpls.h"
+#include "math_helper.h"
+
+#include <span>
 
 #if defined(__i386__) || defined(__x86_64__)
 #   define CU_ENABLED_SIMD
@@ -44,4 +47,11 @@ struct Attribute { // NOLINT(*-pro-type-member-init)
     Attribute operator/(float) const;
 };
 
+// float <-> RGBA8 conversion kernels
+[[nodiscard]] ColorU32 pack_color(const Color& color);
+[[nodiscard]] Color unpack_color(ColorU32 color);
+// packs shaded spans, 4 colors per step with SIMD
+void pack_colors(std::span<const Color> src, ColorU32* dst);
+void fill_colors(ColorU32* dst, size_t n, ColorU32 color);
+
 }
\ No newline at end of file
@@ -61,36 +61,60 @@ Vertex VertexArray::get(const IndexGroup& index) const {
 std::vector<Vertex> VertexArray::getVertices(std::span<const IndexGroup> indices) const {
     std::vector<Vertex> v;
     v.reserve(indices.size());
-    for (auto&& i : indices) v.push_back(get(i));
+    for (auto&& i : vertices(indices)) v.push_back(i);
     return v;
 }
 
 std::vector<std::array<Vertex, 2>> VertexArray::getLines(std::span<const IndexGroup> indices) const {
-    std::vector<std::array<Vertex, 2>> v(indices.size() / 2);
-    for (size_t i = 0; i < indices.size(); i += 2)
-        v.push_back({get(indices[i]), get(indices[i+1])});
+    std::vector<std::array<Vertex, 2>> v;
+    v.reserve(indices.size() / 2);
+    for (auto&& i : lines(indices)) v.push_back(i);
     return v;
 }
 
 std::vector<std::array<Vertex, 3>> VertexArray::getTriangles(std::span<const IndexGroup> indices) const {
-    std::vector<std::array<Vertex, 3>> v(indices.size() / 3);
-    for (size_t i = 0; i < indices.size(); i += 3)
-        v.push_back({get(indices[i]), get(indices[i+1]), get(indices[i+2])});
+    std::vector<std::array<Vertex, 3>> v;
+    v.reserve(indices.size() / 3);
+    for (auto&& i : triangles(indices)) v.push_back(i);
     return v;
 }
 
+void Image::clear_rect(const Rect& rect, const Color& clear_color) {
+    auto [w, h] = size().asArray;
+    auto r = rect.intersect({0, 0, w, h});
+    for (int y = r.y; y < r.y + r.h; y++)
+        for (int x = r.x; x < r.x + r.w; x++)
+            set(uivec2(x, y), clear_color);
+}
+
+ColorU32 Image::get_packed(uivec2 pos) const {
+    return pack_color(get(pos));
+}
+
+void Image::set_packed(uivec2 pos, ColorU32 color) {
+    set(pos, unpack_color(color));
+}
+
 ImageR8::ImageR8(Extent size, ColorFeature mode)
-: size_(size), mode_(mode) {
+: size_(size), stride_(size.x), mode_(mode) {
     data_ = new uint8_t[size.x * size.y]{};
 }
 
+ImageR8::ImageR8(Extent size, uint8_t* data, size_t stride, ColorFeature mode)
+: size_(size), stride_(stride ? stride : size.x), data_(data), mode_(mode), owned_(false) {
+    assert(data_ && stride_ >= size.x);
+}
+
 ImageR8::~ImageR8() {
-    delete[] data_;
+    if (owned_) delete[] data_;
 }
 
 Image* ImageR8::clone() const {
     auto r = new ImageR8{size_, mode_};
-    memcpy(r->data_, data_, size_.x * size_.y);
+    if (stride_ == size_.x)
+        memcpy(r->data_, data_, size_.x * size_.y);
+    else for (int y = 0; y < size_.y; y++)
+        memcpy(r->row(y), row(y), size_.x);
     return r;
 }
 
@@ -99,30 +123,52 @@ Extent ImageR8::size() const {
 }
 
 vec4 ImageR8::get(uivec2 pos) const {
-    return {(float)*(data_ + pos.x + pos.y * size_.x) / 255.f, 0, 0, 0};
+    return {(float)row(pos.y)[pos.x] / 255.f, 0, 0, 0};
 }
 
 void ImageR8::set(uivec2 pos, const Color& color) {
-    *(data_ + pos.x + pos.y * size_.x) =
+    row(pos.y)[pos.x] =
         static_cast<uint8_t>(std::clamp(GetColorFeatureValue(color, mode_), 0.f, 1.f) * 255);
 }
 
 void ImageR8::clear(const Color& clear_color) {
     int c = static_cast<int>(std::clamp(GetColorFeatureValue(clear_color, mode_), 0.f, 1.f) * 255);
-    std::memset(data_, c, size_.x * size_.y);
+    if (stride_ == size_.x)
+        std::memset(data_, c, size_.x * size_.y);
+    else for (int y = 0; y < size_.y; y++)
+        std::memset(row(y), c, size_.x);
 }
 
-ImageRGBA8::ImageRGBA8(Extent size) : size_(size) {
+void ImageR8::clear_rect(const Rect& rect, const Color& clear_color) {
+    int c = static_cast<int>(std::clamp(GetColorFeatureValue(clear_color, mode_), 0.f, 1.f) * 255);
+    auto r = rect.intersect({0, 0, size_.x, size_.y});
+    for (int y = r.y; y < r.y + r.h; y++)
+        std::memset(row(y) + r.x, c, r.w);
+}
+
+uint8_t* ImageR8::row(uint32_t y) const {
+    return data_ + y * stride_;
+}
+
+ImageRGBA8::ImageRGBA8(Extent size) : size_(size), stride_(size.x) {
     data_ = new ColorU32[size_.x * size_.y]{};
 }
 
+ImageRGBA8::ImageRGBA8(Extent size, ColorU32* data, size_t stride)
+: size_(size), stride_(stride ? stride / sizeof(ColorU32) : size.x), data_(data), owned_(false) {
+    assert(data_ && stride % sizeof(ColorU32) == 0 && stride_ >= size.x);
+}
+
 ImageRGBA8::~ImageRGBA8() {
-    delete[] data_;
+    if (owned_) delete[] data_;
 }
 
 Image* ImageRGBA8::clone() const {
     auto r = new ImageRGBA8{size_};
-    memcpy(r->data_, data_, size_.x * size_.y * sizeof(ColorU32));
+    if (stride_ == size_.x)
+        memcpy(r->data_, data_, size_.x * size_.y * sizeof(ColorU32));
+    else for (int y = 0; y < size_.y; y++)
+        memcpy(r->row(y), row(y), size_.x * sizeof(ColorU32));
     return r;
 }
 
@@ -131,17 +177,102 @@ Extent ImageRGBA8::size() const {
 }
 
 Color ImageRGBA8::get(uivec2 pos) const {
-    Color c = *(data_ + pos.x + pos.y * size_.x);
-    return c / 255.f;
+    return unpack_color(row(pos.y)[pos.x]);
 }
 
 void ImageRGBA8::set(uivec2 pos, const Color& color) {
-    *(data_ + pos.x + pos.y * size_.x) = color;
+    row(pos.y)[pos.x] = pack_color(color);
 }
 
 void ImageRGBA8::clear(const Color& clear_color) {
-    auto c = ColorU32(clear_color);
-    std::uninitialized_fill_n(data_, size_.x * size_.y, c);
+    auto c = pack_color(clear_color);
+    if (stride_ == size_.x)
+        fill_colors(data_, size_.x * size_.y, c);
+    else for (int y = 0; y < size_.y; y++)
+        fill_colors(row(y), size_.x, c);
+}
+
+void ImageRGBA8::clear_rect(const Rect& rect, const Color& clear_color) {
+    auto c = pack_color(clear_color);
+    auto r = rect.intersect({0, 0, size_.x, size_.y});
+    for (int y = r.y; y < r.y + r.h; y++)
+        fill_colors(row(y) + r.x, r.w, c);
+}
+
+ColorU32 ImageRGBA8::get_packed(uivec2 pos) const {
+    return row(pos.y)[pos.x];
+}
+
+void ImageRGBA8::set_packed(uivec2 pos, ColorU32 color) {
+    row(pos.y)[pos.x] = color;
+}
+
+ColorU32* ImageRGBA8::row(uint32_t y) const {
+    return data_ + y * stride_;
+}
+
+ImageF32::ImageF32(Extent size) : size_(size), stride_(size.x) {
+    data_ = new float[size_.x * size_.y]{};
+}
+
+ImageF32::ImageF32(Extent size, float* data, size_t stride)
+: size_(size), stride_(stride ? stride / sizeof(float) : size.x), data_(data), owned_(false) {
+    assert(data_ && stride % sizeof(float) == 0 && stride_ >= size.x);
+}
+
+ImageF32::~ImageF32() {
+    if (owned_) delete[] data_;
+}
+
+Image* ImageF32::clone() const {
+    auto r = new ImageF32{size_};
+    if (stride_ == size_.x)
+        memcpy(r->data_, data_, size_.x * size_.y * sizeof(float));
+    else for (int y = 0; y < size_.y; y++)
+        memcpy(r->row(y), row(y), size_.x * sizeof(float));
+    return r;
+}
+
+Extent ImageF32::size() const {
+    return size_;
+}
+
+Color ImageF32::get(uivec2 pos) const {
+    return Color{row(pos.y)[pos.x]};
+}
+
+void ImageF32::set(uivec2 pos, const Color& color) {
+    row(pos.y)[pos.x] = color.r;
+}
+
+void ImageF32::clear(const Color& clear_color) {
+    if (stride_ == size_.x)
+        std::fill_n(data_, size_.x * size_.y, clear_color.r);
+    else for (int y = 0; y < size_.y; y++)
+        std::fill_n(row(y), size_.x, clear_color.r);
+}
+
+void ImageF32::clear_rect(const Rect& rect, const Color& clear_color) {
+    auto r = rect.intersect({0, 0, size_.x, size_.y});
+    for (int y = r.y; y < r.y + r.h; y++)
+        std::fill_n(row(y) + r.x, r.w, clear_color.r);
+}
+
+float* ImageF32::row(uint32_t y) const {
+    return data_ + y * stride_;
+}
+
+std::shared_ptr<Image> make_external_image(void* data, Extent size, size_t stride, PixelFormat format) {
+    switch (format) {
+        case PixelFormat::R8:
+            return std::make_shared<ImageR8>(size, static_cast<uint8_t*>(data), stride);
+        case PixelFormat::RGBA8:
+            return std::make_shared<ImageRGBA8>(size, static_cast<ColorU32*>(data), stride);
+        case PixelFormat::F32:
+            return std::make_shared<ImageF32>(size, static_cast<float*>(data), stride);
+        default:
+            return nullptr;
+    }
 }
 
 Color NearestSampler::get(const Image &image, const vec2 &uv) const {
@@ -197,11 +328,37 @@ mat4 Camera::proj_view() const {
     return frustum.mat * lookAt(position, position + forward, up);
 }
 
+bool Rect::empty() const {
+    return w <= 0 || h <= 0;
+}
+
+bool Rect::contains(ivec2 p) const {
+    return p.x >= x && p.y >= y && p.x < x + w && p.y < y + h;
+}
+
+Rect Rect::intersect(const Rect& o) const {
+    int l = std::max(x, o.x), b = std::max(y, o.y);
+    int r = std::min(x + w, o.x + o.w), t = std::min(y + h, o.y + o.h);
+    return {l, b, std::max(r - l, 0), std::max(t - b, 0)};
+}
+
+Rect Rect::unite(const Rect& o) const {
+    if (empty()) return o;
+    if (o.empty()) return *this;
+    int l = std::min(x, o.x), b = std::min(y, o.y);
+    int r = std::max(x + w, o.x + o.w), t = std::max(y + h, o.y + o.h);
+    return {l, b, r - l, t - b};
+}
+
 vec2 Viewport::translate(const vec2& v) const {
     return {((float)x + (v.x + 1.f) * .5f * ((float)w - 1.f)),
             ((float)y + (v.y + 1.f) * .5f * ((float)h - 1.f))};
 }
 
+Rect Viewport::rect() const {
+    return {std::min(x, x + w), std::min(y, y + h), std::abs(w), std::abs(h)};
+}
+
 Texture::Texture(Image* image, Sampler* sampler) : image(image), sampler(sampler) {}
 
 Color Texture::get(const vec2& uv) const {
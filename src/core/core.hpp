@@ -10,6 +10,7 @@
 #include <span>
 #include <array>
 #include <memory>
+#include <ranges>
 #include <vector>
 #include <cstdint>
 #include <optional>
@@ -61,11 +62,40 @@ struct VertexArray {
 
     [[nodiscard]] Vertex get(const IndexGroup&) const;
 
+    // lazy views, every element is assembled while iterating and nothing is allocated
+    // the indices must outlive the view
+    [[nodiscard]] auto vertices(std::span<const IndexGroup> indices) const {
+        return indices | std::views::transform([this](const IndexGroup& i) {
+            return get(i);
+        });
+    }
+    [[nodiscard]] auto lines(std::span<const IndexGroup> indices) const {
+        return std::views::iota(size_t{0}, indices.size() / 2) | std::views::transform([this, indices](size_t i) {
+            return std::array{get(indices[i * 2]), get(indices[i * 2 + 1])};
+        });
+    }
+    [[nodiscard]] auto triangles(std::span<const IndexGroup> indices) const {
+        return std::views::iota(size_t{0}, indices.size() / 3) | std::views::transform([this, indices](size_t i) {
+            return std::array{get(indices[i * 3]), get(indices[i * 3 + 1]), get(indices[i * 3 + 2])};
+        });
+    }
+
+    // materialized copies of the views
     [[nodiscard]] std::vector<Vertex> getVertices(std::span<const IndexGroup> indices) const;
     [[nodiscard]] std::vector<std::array<Vertex, 2>> getLines(std::span<const IndexGroup> indices) const;
     [[nodiscard]] std::vector<std::array<Vertex, 3>> getTriangles(std::span<const IndexGroup> indices) const;
 };
 
+struct Rect {
+    int x, y;
+    int w, h;
+
+    [[nodiscard]] bool empty() const;
+    [[nodiscard]] bool contains(ivec2 p) const;
+    [[nodiscard]] Rect intersect(const Rect&) const;
+    [[nodiscard]] Rect unite(const Rect&) const;
+};
+
 struct Image {
     virtual ~Image() = default;
     [[nodiscard]] virtual Image* clone() const = 0;
@@ -74,10 +104,23 @@ struct Image {
     [[nodiscard]] virtual Color get(uivec2 pos) const = 0;
     virtual void set(uivec2 pos, const Color& color) = 0;
     virtual void clear(const Color& clear_color) = 0;
+    virtual void clear_rect(const Rect& rect, const Color& clear_color); // rect is clipped to the image
+
+    // packed RGBA8 access, typed images override these to skip the float conversion
+    [[nodiscard]] virtual ColorU32 get_packed(uivec2 pos) const;
+    virtual void set_packed(uivec2 pos, ColorU32 color);
+};
+
+enum class PixelFormat {
+    R8,
+    RGBA8,
+    F32
 };
 
 struct ImageR8 : Image {
     explicit ImageR8(Extent size, ColorFeature mode = ColorFeature::R);
+    // wraps caller-owned memory, stride is in bytes and the memory is never freed by the image
+    ImageR8(Extent size, uint8_t* data, size_t stride, ColorFeature mode = ColorFeature::R);
     ~ImageR8() override;
     [[nodiscard]] Image* clone() const override;
 
@@ -87,14 +130,21 @@ struct ImageR8 : Image {
     [[nodiscard]] Color get(uivec2 pos) const override;
     void set(uivec2 pos, const Color& color) override;
     void clear(const Color& clear_color) override;
+    void clear_rect(const Rect& rect, const Color& clear_color) override;
+
+    [[nodiscard]] uint8_t* row(uint32_t y) const;
     
     Extent size_;
+    size_t stride_; // in pixels
     uint8_t* data_;
     ColorFeature mode_;
+    bool owned_ = true;
 };
 
 struct ImageRGBA8 : Image {
     explicit ImageRGBA8(Extent size);
+    // wraps caller-owned memory, stride is in bytes and the memory is never freed by the image
+    ImageRGBA8(Extent size, ColorU32* data, size_t stride);
     ~ImageRGBA8() override;
     [[nodiscard]] Image* clone() const override;
 
@@ -104,11 +154,47 @@ struct ImageRGBA8 : Image {
     [[nodiscard]] Color get(uivec2 pos) const override;
     void set(uivec2 pos, const Color& color) override;
     void clear(const Color& clear_color) override;
+    void clear_rect(const Rect& rect, const Color& clear_color) override;
+
+    [[nodiscard]] ColorU32 get_packed(uivec2 pos) const override;
+    void set_packed(uivec2 pos, ColorU32 color) override;
+
+    [[nodiscard]] ColorU32* row(uint32_t y) const;
     
     Extent size_;
+    size_t stride_; // in pixels
     ColorU32* data_;
+    bool owned_ = true;
+};
+
+// single channel float image, meant for depth
+struct ImageF32 : Image {
+    explicit ImageF32(Extent size);
+    // wraps caller-owned memory, stride is in bytes and the memory is never freed by the image
+    ImageF32(Extent size, float* data, size_t stride);
+    ~ImageF32() override;
+    [[nodiscard]] Image* clone() const override;
+
+    ImageF32(ImageF32&&) = delete;
+
+    [[nodiscard]] Extent size() const override;
+    [[nodiscard]] Color get(uivec2 pos) const override; // broadcast to all channels
+    void set(uivec2 pos, const Color& color) override;  // stores the r channel
+    void clear(const Color& clear_color) override;
+    void clear_rect(const Rect& rect, const Color& clear_color) override;
+
+    [[nodiscard]] float* row(uint32_t y) const;
+
+    Extent size_;
+    size_t stride_; // in pixels
+    float* data_;
+    bool owned_ = true;
 };
 
+// zero-copy adapter over external memory (shared memory, video frames, mmap'd files...)
+// stride is in bytes, 0 means tightly packed
+std::shared_ptr<Image> make_external_image(void* data, Extent size, size_t stride, PixelFormat format);
+
 struct Sampler {
     virtual ~Sampler() = default;
     [[nodiscard]] virtual Color get(const Image& image, const vec2& uv) const = 0;
@@ -151,8 +237,9 @@ struct Camera {
 
 struct Viewport {
     int x, y;
-    int w, h;
+    int w, h; // might be negative to flip the axis
     [[nodiscard]] vec2 translate(const vec2&) const;
+    [[nodiscard]] Rect rect() const; // area covered on the target
 };
 
 enum class Topology {
@@ -161,8 +248,13 @@ enum class Topology {
     triangle,
     triangle_fan,
     triangle_line,
+    triangle_strip,
+    line_strip,
 };
 
+// index ending a strip or fan, the next index starts a new one
+constexpr uint32_t primitive_restart = UINT32_MAX;
+
 enum class CullFace {
     none,
     clockwise,
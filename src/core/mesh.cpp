@@ -0,0 +1,119 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "mesh.hpp"
+
+namespace cu {
+
+size_t MeshView::vertex_count() const {
+    return positions.size();
+}
+
+size_t MeshView::index_count() const {
+    return indices32.empty() ? indices16.size() : indices32.size();
+}
+
+uint32_t MeshView::index(size_t i) const {
+    if (!indices32.empty()) return indices32[i];
+    auto v = indices16[i];
+    return v == UINT16_MAX ? primitive_restart : v;
+}
+
+Vertex MeshView::get(uint32_t i) const {
+    Vertex v;
+    v.pos = positions[i];
+    if (!normals.empty()) v.attr.var.normal = normals[i];
+    if (!uvs.empty()) v.attr.var.uv = uvs[i];
+    if (!colors.empty()) v.attr.var.color = colors[i];
+    return v;
+}
+
+std::vector<uint32_t> MeshView::get_indices() const {
+    std::vector<uint32_t> r;
+    r.reserve(index_count());
+    for (auto i : indices(0, index_count())) r.push_back(i);
+    return r;
+}
+
+MeshView IndexedMesh::view() const {
+    return {positions, normals, uvs, colors, indices16, indices32};
+}
+
+size_t IndexedMesh::vertex_count() const {
+    return positions.size();
+}
+
+size_t IndexedMesh::index_count() const {
+    return indices32.empty() ? indices16.size() : indices32.size();
+}
+
+std::vector<uint32_t> IndexedMesh::get_indices() const {
+    return view().get_indices();
+}
+
+void IndexedMesh::set_indices(std::span<const uint32_t> indices) {
+    indices16.clear();
+    indices32.clear();
+    // all ones is the restart index, so 16 bits hold up to 65535 vertices
+    if (vertex_count() < UINT16_MAX) {
+        indices16.reserve(indices.size());
+        for (auto i : indices) indices16.push_back(i == primitive_restart ? UINT16_MAX : (uint16_t)i);
+    } else {
+        indices32.assign(indices.begin(), indices.end());
+    }
+}
+
+IndexedMesh weld(const VertexArray& array, std::span<const IndexGroup> indices) {
+    struct Key {
+        uint32_t pos, nor, uv, col; // attributes are offset by one, 0 is none
+
+        bool operator==(const Key&) const = default;
+    };
+    auto hash = [](const Key& k) {
+        uint64_t h = k.pos;
+        h = h * 0x9E3779B97F4A7C15ull ^ k.nor;
+        h = h * 0x9E3779B97F4A7C15ull ^ k.uv;
+        h = h * 0x9E3779B97F4A7C15ull ^ k.col;
+        return (size_t)(h ^ h >> 29);
+    };
+
+    bool has_nor = false, has_uv = false, has_col = false;
+    for (auto&& i : indices) {
+        if (i.pos == primitive_restart) continue;
+        has_nor |= i.nor.has_value(), has_uv |= i.uv.has_value(), has_col |= i.col.has_value();
+    }
+
+    // open addressing over the welded vertices, at most half full
+    size_t capacity = 16;
+    while (capacity < indices.size() * 2) capacity <<= 1;
+    std::vector<uint32_t> slots(capacity, primitive_restart);
+    std::vector<Key> keys;
+
+    IndexedMesh mesh;
+    std::vector<uint32_t> remap;
+    remap.reserve(indices.size());
+    for (auto&& i : indices) {
+        if (i.pos == primitive_restart) {
+            remap.push_back(primitive_restart);
+            continue;
+        }
+        Key key{i.pos, i.nor ? *i.nor + 1 : 0, i.uv ? *i.uv + 1 : 0, i.col ? *i.col + 1 : 0};
+        size_t s = hash(key) & (capacity - 1);
+        while (slots[s] != primitive_restart && keys[slots[s]] != key) s = (s + 1) & (capacity - 1);
+        if (slots[s] == primitive_restart) {
+            slots[s] = (uint32_t)keys.size();
+            keys.push_back(key);
+            mesh.positions.push_back(array.positions.at(i.pos));
+            if (has_nor) mesh.normals.push_back(i.nor ? array.normals.at(*i.nor) : vec3{});
+            if (has_uv) mesh.uvs.push_back(i.uv ? array.uvs.at(*i.uv) : vec2{});
+            if (has_col) mesh.colors.push_back(i.col ? array.colors.at(*i.col) : vec4{});
+        }
+        remap.push_back(slots[s]);
+    }
+
+    mesh.set_indices(remap);
+    return mesh;
+}
+
+}
@@ -0,0 +1,66 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "core.hpp"
+
+namespace cu {
+
+// single index mesh, the attributes live in separate streams (SoA)
+// a stream is either empty or as long as positions, so fetching has one predictable branch per stream
+// non-owning, the memory may as well be a mapped file
+struct MeshView {
+    std::span<const vec3> positions;
+    std::span<const vec3> normals;
+    std::span<const vec2> uvs;
+    std::span<const vec4> colors;
+
+    // only one of them is used, 16 bits while the vertex count allows
+    // the restart index is all ones in either width
+    std::span<const uint16_t> indices16;
+    std::span<const uint32_t> indices32;
+
+    [[nodiscard]] size_t vertex_count() const;
+    [[nodiscard]] size_t index_count() const;
+    // widened, restarts are returned as primitive_restart
+    [[nodiscard]] uint32_t index(size_t i) const;
+    [[nodiscard]] Vertex get(uint32_t vertex) const;
+
+    // widened copy of all indices
+    [[nodiscard]] std::vector<uint32_t> get_indices() const;
+
+    // widened indices of [b, e), the view must outlive them
+    [[nodiscard]] auto indices(size_t b, size_t e) const {
+        return std::views::iota(b, e) | std::views::transform([this](size_t i) {
+            return index(i);
+        });
+    }
+};
+
+// owning version of MeshView
+struct IndexedMesh {
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    std::vector<vec2> uvs;
+    std::vector<vec4> colors;
+
+    std::vector<uint16_t> indices16;
+    std::vector<uint32_t> indices32;
+
+    [[nodiscard]] MeshView view() const;
+    operator MeshView() const { return view(); }
+
+    [[nodiscard]] size_t vertex_count() const;
+    [[nodiscard]] size_t index_count() const;
+    [[nodiscard]] std::vector<uint32_t> get_indices() const;
+    // stores the indices in the narrowest width the vertex count allows, primitive_restart is kept
+    void set_indices(std::span<const uint32_t> indices);
+};
+
+// merges the corners with equal IndexGroups into one vertex, restarts are kept
+// attributes referenced by only some corners get zeros on the others
+[[nodiscard]] IndexedMesh weld(const VertexArray& array, std::span<const IndexGroup> indices);
+
+}
@@ -0,0 +1,376 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "mesh_io.hpp"
+#include "parallel.hpp"
+
+#include <thread>
+#include <utility>
+#include <cstring>
+#include <fstream>
+#include <charconv>
+#include <algorithm>
+
+#ifdef _WIN32
+#   define NOMINMAX
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+namespace cu {
+
+namespace {
+
+constexpr char mesh_magic[4] = {'C', 'U', 'M', 'S'};
+constexpr uint32_t mesh_version = 1;
+constexpr uint64_t section_align = 64;
+
+enum Section { positions, normals, uvs, colors, indices, section_count };
+
+struct MeshFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t vertex_count;
+    uint64_t index_count;
+    uint32_t index_size; // 2 or 4
+    uint32_t reserved;
+    struct {
+        uint64_t offset, size; // in bytes from the start of the file
+    } sections[section_count];
+};
+
+// whole file mapped read-only, null if it can't be
+std::pair<void*, size_t> map_file(const std::string& path) {
+#ifdef _WIN32
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return {};
+    LARGE_INTEGER size{};
+    void* data = nullptr;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        if (auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps the mapping alive
+        }
+    }
+    CloseHandle(file);
+    return data ? std::pair{data, (size_t)size.QuadPart} : std::pair<void*, size_t>{};
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return {};
+    struct stat st{};
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping outlives the descriptor
+    return data != MAP_FAILED ? std::pair{data, (size_t)st.st_size} : std::pair<void*, size_t>{};
+#endif
+}
+
+void unmap_file(void* data, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+template <class T>
+std::span<const T> section(const void* data, const MeshFileHeader& h, Section s) {
+    return {reinterpret_cast<const T*>((const char*)data + h.sections[s].offset), h.sections[s].size / sizeof(T)};
+}
+
+}
+
+bool save_mesh(const std::string& path, const MeshView& mesh) {
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file) return false;
+
+    const bool wide = !mesh.indices32.empty();
+    const std::span<const std::byte> data[section_count] = {
+        std::as_bytes(mesh.positions), std::as_bytes(mesh.normals), std::as_bytes(mesh.uvs), std::as_bytes(mesh.colors),
+        wide ? std::as_bytes(mesh.indices32) : std::as_bytes(mesh.indices16)
+    };
+
+    MeshFileHeader h{};
+    std::memcpy(h.magic, mesh_magic, sizeof(mesh_magic));
+    h.version = mesh_version;
+    h.vertex_count = mesh.vertex_count();
+    h.index_count = mesh.index_count();
+    h.index_size = wide ? 4 : 2;
+    uint64_t offset = sizeof(h);
+    for (int s = 0; s < section_count; s++) {
+        offset = (offset + section_align - 1) & ~(section_align - 1);
+        h.sections[s] = {offset, data[s].size()};
+        offset += data[s].size();
+    }
+
+    static constexpr char zeros[section_align]{};
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    for (int s = 0; s < section_count; s++) {
+        file.write(zeros, (std::streamsize)(h.sections[s].offset - (uint64_t)file.tellp()));
+        file.write(reinterpret_cast<const char*>(data[s].data()), (std::streamsize)data[s].size());
+    }
+    return (bool)file.flush();
+}
+
+MappedMesh::~MappedMesh() {
+    close();
+}
+
+MappedMesh::MappedMesh(MappedMesh&& o) noexcept :
+    data(std::exchange(o.data, nullptr)), size(std::exchange(o.size, 0)), mesh(std::exchange(o.mesh, {})) {}
+
+MappedMesh& MappedMesh::operator=(MappedMesh&& o) noexcept {
+    if (this != &o) {
+        close();
+        data = std::exchange(o.data, nullptr);
+        size = std::exchange(o.size, 0);
+        mesh = std::exchange(o.mesh, {});
+    }
+    return *this;
+}
+
+bool MappedMesh::open(const std::string& path) {
+    close();
+    auto [d, n] = map_file(path);
+    if (!d) return false;
+    data = d, size = n;
+
+    MeshFileHeader h{};
+    if (n < sizeof(h)) return close(), false;
+    std::memcpy(&h, d, sizeof(h));
+
+    const uint64_t elem[section_count] = {sizeof(vec3), sizeof(vec3), sizeof(vec2), sizeof(vec4), h.index_size};
+    bool ok = std::memcmp(h.magic, mesh_magic, sizeof(mesh_magic)) == 0 && h.version == mesh_version &&
+              (h.index_size == 2 || h.index_size == 4);
+    for (int s = 0; ok && s < section_count; s++) {
+        auto [offset, bytes] = h.sections[s];
+        auto count = s == indices ? h.index_count : h.vertex_count;
+        // divided rather than multiplied, a huge count must not wrap around to the size
+        ok = offset % section_align == 0 && offset <= n && bytes <= n - offset && bytes % elem[s] == 0 &&
+             (bytes / elem[s] == count || (bytes == 0 && s != positions && s != indices));
+    }
+    if (!ok) return close(), false;
+
+    // draws index the vertices unchecked, a single out of range index rejects the file
+    auto in_range = [&h](auto idx, auto restart) {
+        return std::all_of(idx.begin(), idx.end(), [&](auto i) { return i == restart || i < h.vertex_count; });
+    };
+    if (!(h.index_size == 4 ? in_range(section<uint32_t>(d, h, indices), UINT32_MAX)
+                            : in_range(section<uint16_t>(d, h, indices), UINT16_MAX)))
+        return close(), false;
+
+    mesh.positions = section<vec3>(d, h, positions);
+    mesh.normals = section<vec3>(d, h, normals);
+    mesh.uvs = section<vec2>(d, h, uvs);
+    mesh.colors = section<vec4>(d, h, colors);
+    if (h.index_size == 4) mesh.indices32 = section<uint32_t>(d, h, indices);
+    else mesh.indices16 = section<uint16_t>(d, h, indices);
+    return true;
+}
+
+void MappedMesh::close() {
+    if (data) unmap_file(data, size);
+    data = nullptr, size = 0, mesh = {};
+}
+
+bool MappedMesh::is_open() const {
+    return data;
+}
+
+const MeshView& MappedMesh::view() const {
+    return mesh;
+}
+
+namespace {
+
+struct ObjChunk {
+    const char *begin, *end;
+    // counts of v, vt and vn lines, then their offsets among all chunks
+    size_t v = 0, vt = 0, vn = 0;
+
+    std::vector<vec3> positions, normals;
+    std::vector<vec4> colors;
+    std::vector<vec2> uvs;
+    std::vector<IndexGroup> corners; // triangulated
+    bool has_color = false, ok = true;
+};
+
+template <class F>
+void for_lines(const char* p, const char* end, F&& fn) {
+    while (p < end) {
+        auto e = (const char*)std::memchr(p, '\n', end - p);
+        if (!e) e = end;
+        auto le = e;
+        if (le > p && le[-1] == '\r') --le;
+        fn(p, le);
+        p = e + 1;
+    }
+}
+
+const char* skip_space(const char* p, const char* e) {
+    while (p < e && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+// parses up to n floats, returns how many
+int parse_floats(const char* p, const char* e, float* out, int n) {
+    int i = 0;
+    for (; i < n; i++) {
+        p = skip_space(p, e);
+        auto [next, ec] = std::from_chars(p, e, out[i]);
+        if (ec != std::errc{}) break;
+        p = next;
+    }
+    return i;
+}
+
+// 1 based or negative relative to `count` lines seen so far, 0 based result or -1 if invalid
+int64_t resolve(int64_t i, size_t count, size_t total) {
+    int64_t r = i > 0 ? i - 1 : (int64_t)count + i;
+    return i != 0 && r >= 0 && r < (int64_t)total ? r : -1;
+}
+
+void parse_chunk(ObjChunk& c, size_t total_v, size_t total_vt, size_t total_vn) {
+    // the counters start at the offsets of the chunk, so relative indices resolve across chunks
+    size_t v = c.v, vt = c.vt, vn = c.vn;
+    std::vector<IndexGroup> face;
+    for_lines(c.begin, c.end, [&](const char* p, const char* e) {
+        p = skip_space(p, e);
+        if (e - p < 2) return;
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            float f[7]{0, 0, 0, 1, 1, 1, 1};
+            auto n = parse_floats(p + 2, e, f, 6);
+            c.positions.push_back({f[0], f[1], f[2]});
+            c.colors.push_back({f[3], f[4], f[5], 1.f});
+            c.has_color |= n == 6;
+            ++v;
+        } else if (p[0] == 'v' && p[1] == 't') {
+            float f[2]{};
+            parse_floats(p + 2, e, f, 2);
+            c.uvs.push_back({f[0], f[1]});
+            ++vt;
+        } else if (p[0] == 'v' && p[1] == 'n') {
+            float f[3]{};
+            parse_floats(p + 2, e, f, 3);
+            c.normals.push_back({f[0], f[1], f[2]});
+            ++vn;
+        } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            face.clear();
+            p += 2;
+            while ((p = skip_space(p, e)) < e) {
+                // v, v/t, v//n or v/t/n
+                int64_t ids[3]{};
+                bool present[3]{};
+                for (int k = 0; k < 3 && p < e; k++) {
+                    if (*p != '/') {
+                        auto [next, ec] = std::from_chars(p, e, ids[k]);
+                        present[k] = ec == std::errc{};
+                        p = next;
+                    }
+                    if (p >= e || *p != '/') break;
+                    ++p;
+                }
+                while (p < e && *p != ' ' && *p != '\t') ++p;
+
+                IndexGroup g{};
+                auto pos = present[0] ? resolve(ids[0], v, total_v) : -1;
+                auto uv = present[1] ? resolve(ids[1], vt, total_vt) : 0;
+                auto nor = present[2] ? resolve(ids[2], vn, total_vn) : 0;
+                if (pos < 0 || uv < 0 || nor < 0) {
+                    c.ok = false;
+                    return;
+                }
+                g.pos = (uint32_t)pos;
+                if (present[1]) g.uv = (uint32_t)uv;
+                if (present[2]) g.nor = (uint32_t)nor;
+                face.push_back(g);
+            }
+            for (size_t i = 2; i < face.size(); i++) {
+                c.corners.push_back(face[0]);
+                c.corners.push_back(face[i - 1]);
+                c.corners.push_back(face[i]);
+            }
+        }
+    });
+}
+
+}
+
+std::optional<IndexedMesh> load_obj(const std::string& path, st::ThreadPool* pool, int workers) {
+    auto [data, size] = map_file(path);
+    if (!data) return std::nullopt;
+    const char* text = (const char*)data;
+
+    // chunks end at line breaks, a few per thread so uneven ones balance out
+    constexpr size_t min_chunk = 1 << 20;
+    int threads = !pool ? 1 : workers > 0 ? workers : std::max((int)std::thread::hardware_concurrency(), 1);
+    size_t count = std::clamp<size_t>(size / min_chunk, 1, (size_t)threads * 4);
+    std::vector<ObjChunk> chunks;
+    for (size_t i = 0, b = 0; i < count && b < size; i++) {
+        size_t e = i + 1 == count ? size : std::max(b, size / count * (i + 1));
+        if (auto nl = (const char*)std::memchr(text + e, '\n', size - e); nl && e < size) e = nl - text + 1;
+        else e = size;
+        auto& chunk = chunks.emplace_back();
+        chunk.begin = text + b, chunk.end = text + e;
+        b = e;
+    }
+
+    // chunks are claimed dynamically, the calling thread works as well
+    auto parallel = [&](auto&& fn) {
+        parallel_for(pool, threads, (int)chunks.size(), [&](int c) { fn(chunks[c]); });
+    };
+
+    // first pass counts the vertex lines, so relative indices can be resolved while parsing
+    parallel([](ObjChunk& c) {
+        for_lines(c.begin, c.end, [&](const char* p, const char* e) {
+            p = skip_space(p, e);
+            if (e - p < 2 || p[0] != 'v') return;
+            c.v += p[1] == ' ' || p[1] == '\t';
+            c.vt += p[1] == 't';
+            c.vn += p[1] == 'n';
+        });
+    });
+    size_t total_v = 0, total_vt = 0, total_vn = 0;
+    for (auto& c : chunks) {
+        total_v += std::exchange(c.v, total_v);
+        total_vt += std::exchange(c.vt, total_vt);
+        total_vn += std::exchange(c.vn, total_vn);
+    }
+
+    parallel([&](ObjChunk& c) { parse_chunk(c, total_v, total_vt, total_vn); });
+    unmap_file(data, size);
+
+    VertexArray va;
+    std::vector<IndexGroup> corners;
+    bool has_color = false;
+    size_t total_corners = 0;
+    for (auto& c : chunks) {
+        if (!c.ok) return std::nullopt;
+        has_color |= c.has_color;
+        total_corners += c.corners.size();
+    }
+    va.positions.reserve(total_v), va.uvs.reserve(total_vt), va.normals.reserve(total_vn);
+    if (has_color) va.colors.reserve(total_v);
+    corners.reserve(total_corners);
+    for (auto& c : chunks) {
+        va.positions.insert(va.positions.end(), c.positions.begin(), c.positions.end());
+        va.uvs.insert(va.uvs.end(), c.uvs.begin(), c.uvs.end());
+        va.normals.insert(va.normals.end(), c.normals.begin(), c.normals.end());
+        if (has_color) va.colors.insert(va.colors.end(), c.colors.begin(), c.colors.end());
+        for (auto g : c.corners) {
+            if (has_color) g.col = g.pos;
+            corners.push_back(g);
+        }
+        c = {}; // release the chunk early, large files hold a lot
+    }
+
+    return weld(va, corners);
+}
+
+}
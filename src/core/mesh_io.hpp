@@ -0,0 +1,51 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "mesh.hpp"
+#include "sethread.h"
+
+#include <string>
+
+namespace cu {
+
+// binary mesh file, native endianness
+// a header followed by the position, normal, uv, color and index sections, each 64 byte aligned
+// so a mapping can be viewed in place
+
+// false if the file couldn't be written
+bool save_mesh(const std::string& path, const MeshView& mesh);
+
+// read-only mapping of a mesh file, nothing is copied
+class MappedMesh {
+public:
+    MappedMesh() = default;
+    ~MappedMesh();
+
+    MappedMesh(MappedMesh&&) noexcept;
+    MappedMesh& operator=(MappedMesh&&) noexcept;
+
+    // false if the file is missing, truncated, not a mesh file or has indices past the vertices
+    bool open(const std::string& path);
+    void close();
+
+    [[nodiscard]] bool is_open() const;
+    // valid until closed, empty if nothing is open
+    [[nodiscard]] const MeshView& view() const;
+    operator const MeshView&() const { return view(); }
+
+private:
+    void* data = nullptr;
+    size_t size = 0;
+    MeshView mesh;
+};
+
+// Wavefront OBJ, faces are triangulated as fans and the corners welded
+// `v x y z r g b` colors are kept, groups, objects and materials are ignored
+// lines are parsed in parallel on the pool if given, nullopt if the file can't be read
+// `workers` is the thread count of the pool, 0 takes the hardware concurrency
+[[nodiscard]] std::optional<IndexedMesh> load_obj(const std::string& path, st::ThreadPool* pool = nullptr, int workers = 0);
+
+}
@@ -0,0 +1,361 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "optimize.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <numeric>
+#include <algorithm>
+
+namespace cu {
+
+namespace {
+
+constexpr int max_cache_size = 64;
+
+// [Linear-Speed Vertex Cache Optimisation](https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html)
+float vertex_score(int cache_pos, uint32_t remaining, int cache_size) {
+    if (remaining == 0) return -1.f; // no triangle left to draw
+    float s = 0.f;
+    if (cache_pos >= 0) {
+        if (cache_pos < 3) s = .75f; // used by the last triangle, fixed so it isn't strongly preferred
+        else s = std::pow(1.f - float(cache_pos - 3) / float(cache_size - 3), 1.5f);
+    }
+    // low valence vertices are finished first, so no lone triangles are left behind
+    return s + 2.f / std::sqrt((float)remaining);
+}
+
+// triangles around every vertex, in compressed rows
+struct Adjacency {
+    std::vector<uint32_t> offsets, counts, triangles;
+
+    Adjacency(std::span<const uint32_t> indices, size_t vertex_count) :
+        offsets(vertex_count), counts(vertex_count), triangles(indices.size())
+    {
+        for (auto i : indices) counts[i]++;
+        std::exclusive_scan(counts.begin(), counts.end(), offsets.begin(), 0u);
+        std::vector<uint32_t> fill = offsets;
+        for (size_t i = 0; i < indices.size(); i++)
+            triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+    }
+};
+
+// fresh FIFO cache simulation, miss() loads the vertex and returns true if it wasn't cached
+struct FifoCache {
+    std::vector<uint32_t> stamps;
+    uint32_t time;
+    int size;
+
+    FifoCache(size_t vertex_count, int size) : stamps(vertex_count, 0), time(size + 1), size(size) {}
+
+    bool miss(uint32_t v) {
+        if (time - stamps[v] <= (uint32_t)size) return false;
+        stamps[v] = time++;
+        return true;
+    }
+    void reset() { time += size + 1; }
+};
+
+vec3 triangle_normal(std::span<const vec3> p, const uint32_t* t) {
+    return cross(p[t[1]] - p[t[0]], p[t[2]] - p[t[0]]); // twice the area long
+}
+
+}
+
+void optimize_vertex_cache(IndexedMesh& mesh, int cache_size) {
+    auto indices = mesh.get_indices();
+    const size_t tri_count = indices.size() / 3;
+    const size_t vn = mesh.vertex_count();
+    if (tri_count == 0) return;
+    cache_size = std::clamp(cache_size, 4, max_cache_size);
+
+    Adjacency adj{indices, vn};
+    auto& live = adj.counts; // triangles not emitted yet, at the front of each row
+
+    std::vector<int> cache_pos(vn, -1);
+    std::vector<float> score(vn);
+    for (size_t v = 0; v < vn; v++) score[v] = vertex_score(-1, live[v], cache_size);
+
+    auto tri_score = [&](size_t t) {
+        return score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    };
+
+    std::vector<uint8_t> emitted(tri_count, 0);
+    std::vector<uint32_t> cache, next_cache;
+    cache.reserve(cache_size + 3), next_cache.reserve(cache_size + 3);
+    std::vector<uint32_t> result;
+    result.reserve(tri_count * 3);
+
+    // the first triangle is the best one of the whole mesh
+    size_t best = 0;
+    for (size_t t = 1; t < tri_count; t++)
+        if (tri_score(t) > tri_score(best)) best = t;
+
+    size_t cursor = 0; // fallback in input order once the cache holds no live triangles
+    while (true) {
+        emitted[best] = 1;
+        const uint32_t* tv = indices.data() + best * 3;
+        result.insert(result.end(), tv, tv + 3);
+        if (result.size() == tri_count * 3) break;
+
+        for (int k = 0; k < 3; k++) {
+            auto row = adj.triangles.data() + adj.offsets[tv[k]];
+            auto n = live[tv[k]]--;
+            std::swap(*std::find(row, row + n, (uint32_t)best), row[n - 1]);
+        }
+
+        // the triangle moves to the front, entries past cache_size fall out
+        next_cache.clear();
+        for (int k = 0; k < 3; k++)
+            if (std::find(next_cache.begin(), next_cache.end(), tv[k]) == next_cache.end())
+                next_cache.push_back(tv[k]);
+        for (auto v : cache)
+            if (v != tv[0] && v != tv[1] && v != tv[2]) next_cache.push_back(v);
+        for (size_t i = 0; i < next_cache.size(); i++) {
+            auto v = next_cache[i];
+            cache_pos[v] = i < (size_t)cache_size ? (int)i : -1;
+            score[v] = vertex_score(cache_pos[v], live[v], cache_size);
+        }
+        next_cache.resize(std::min(next_cache.size(), (size_t)cache_size));
+        std::swap(cache, next_cache);
+
+        // only the triangles around cached vertices changed their scores
+        float best_score = -1.f;
+        for (auto v : cache) {
+            auto row = adj.triangles.data() + adj.offsets[v];
+            for (uint32_t i = 0; i < live[v]; i++)
+                if (auto s = tri_score(row[i]); s > best_score) best_score = s, best = row[i];
+        }
+        if (best_score < 0.f) {
+            while (emitted[cursor]) ++cursor;
+            best = cursor;
+        }
+    }
+
+    mesh.set_indices(result);
+}
+
+float average_cache_miss_ratio(const MeshView& mesh, int cache_size) {
+    const size_t n = mesh.index_count();
+    if (n < 3) return 0.f;
+    FifoCache cache{mesh.vertex_count(), cache_size};
+    size_t misses = 0;
+    for (auto i : mesh.indices(0, n))
+        misses += cache.miss(i);
+    return (float)misses / (float)(n / 3);
+}
+
+void optimize_overdraw(IndexedMesh& mesh, float threshold, int cache_size) {
+    auto indices = mesh.get_indices();
+    const size_t tri_count = indices.size() / 3;
+    if (tri_count == 0) return;
+
+    // hard boundaries, triangles missing the cache with all three vertices start a cluster
+    std::vector<size_t> clusters;
+    {
+        FifoCache cache{mesh.vertex_count(), cache_size};
+        for (size_t t = 0; t < tri_count; t++) {
+            int m = 0;
+            for (int k = 0; k < 3; k++) m += cache.miss(indices[t * 3 + k]);
+            if (m == 3) clusters.push_back(t);
+        }
+    }
+    clusters.push_back(tri_count);
+
+    // soft boundaries, a hard cluster is split as soon as its prefix is about as cache efficient as the whole
+    std::vector<size_t> bounds;
+    {
+        FifoCache cache{mesh.vertex_count(), cache_size};
+        for (size_t c = 0; c + 1 < clusters.size(); c++) {
+            const size_t b = clusters[c], e = clusters[c + 1];
+            cache.reset();
+            size_t misses = 0;
+            for (size_t i = b * 3; i < e * 3; i++) misses += cache.miss(indices[i]);
+            const float acmr = (float)misses / (float)(e - b);
+
+            cache.reset();
+            bounds.push_back(b);
+            size_t start = b;
+            misses = 0;
+            for (size_t t = b; t < e; t++) {
+                for (int k = 0; k < 3; k++) misses += cache.miss(indices[t * 3 + k]);
+                if (t + 1 < e && (float)misses / (float)(t + 1 - start) <= acmr * threshold) {
+                    bounds.push_back(t + 1);
+                    start = t + 1, misses = 0;
+                    cache.reset();
+                }
+            }
+        }
+    }
+    bounds.push_back(tri_count);
+
+    vec3 mesh_center{};
+    for (auto&& p : mesh.positions) mesh_center += p;
+    mesh_center /= (float)std::max<size_t>(mesh.vertex_count(), 1);
+
+    // how far a cluster faces outward, from its area weighted centroid and normal
+    std::vector<float> keys(bounds.size() - 1);
+    for (size_t c = 0; c < keys.size(); c++) {
+        vec3 center{}, normal{};
+        float area = 0.f;
+        for (size_t t = bounds[c]; t < bounds[c + 1]; t++) {
+            const uint32_t* tv = indices.data() + t * 3;
+            auto n = triangle_normal(mesh.positions, tv);
+            auto a = n.length();
+            center += (mesh.positions[tv[0]] + mesh.positions[tv[1]] + mesh.positions[tv[2]]) * (a / 3.f);
+            normal += n;
+            area += a;
+        }
+        center = area > 0.f ? center / area : mesh.positions[indices[bounds[c] * 3]];
+        auto len = normal.length();
+        keys[c] = len > 0.f ? dot(center - mesh_center, normal / len) : 0.f;
+    }
+
+    std::vector<uint32_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(tri_count * 3);
+    for (auto c : order)
+        result.insert(result.end(), indices.begin() + bounds[c] * 3, indices.begin() + bounds[c + 1] * 3);
+    mesh.set_indices(result);
+}
+
+void optimize_vertex_fetch(IndexedMesh& mesh) {
+    auto indices = mesh.get_indices();
+    std::vector<uint32_t> remap(mesh.vertex_count(), primitive_restart);
+    uint32_t next = 0;
+    for (auto& i : indices) {
+        if (i == primitive_restart) continue;
+        if (remap[i] == primitive_restart) remap[i] = next++;
+        i = remap[i];
+    }
+
+    auto reorder = [&](auto& stream) {
+        if (stream.empty()) return;
+        std::remove_reference_t<decltype(stream)> r(next);
+        for (size_t v = 0; v < remap.size(); v++)
+            if (remap[v] != primitive_restart) r[remap[v]] = stream[v];
+        stream = std::move(r);
+    };
+    reorder(mesh.positions);
+    reorder(mesh.normals);
+    reorder(mesh.uvs);
+    reorder(mesh.colors);
+
+    mesh.set_indices(indices); // fewer vertices might fit 16 bits now
+}
+
+bool Meshlet::backfacing(const vec3& camera_position) const {
+    auto d = center - camera_position;
+    return dot(d, cone_axis) >= cone_cutoff * d.length() + radius;
+}
+
+MeshletSet build_meshlets(const MeshView& mesh, size_t max_vertices, size_t max_triangles) {
+    assert(max_vertices >= 3 && max_vertices <= 256 && max_triangles >= 1);
+    auto indices = mesh.get_indices();
+    const size_t tri_count = indices.size() / 3;
+    const size_t vn = mesh.vertex_count();
+
+    Adjacency adj{indices, vn};
+    std::vector<vec3> normals(tri_count);
+    for (size_t t = 0; t < tri_count; t++) {
+        auto n = triangle_normal(mesh.positions, indices.data() + t * 3);
+        auto len = n.length();
+        normals[t] = len > 0.f ? n / len : vec3{};
+    }
+
+    MeshletSet set;
+    std::vector<int> local(vn, -1); // meshlet vertex of the current meshlet
+    std::vector<uint8_t> emitted(tri_count, 0);
+
+    auto finish = [&](Meshlet& m) {
+        auto verts = std::span(set.vertices).subspan(m.vertex_offset, m.vertex_count);
+        for (auto v : verts) local[v] = -1;
+
+        vec3 lo = mesh.positions[verts[0]], hi = lo;
+        for (auto v : verts) {
+            auto& p = mesh.positions[v];
+            lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+            hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+        }
+        m.center = (lo + hi) * .5f;
+        m.radius = 0.f;
+        for (auto v : verts) m.radius = std::max(m.radius, (mesh.positions[v] - m.center).length());
+
+        float min_dot = 1.f;
+        if (auto len = m.cone_axis.length(); len > 0.f) {
+            m.cone_axis /= len;
+            for (uint32_t t = 0; t < m.triangle_count; t++) {
+                const uint8_t* lt = set.triangles.data() + (m.triangle_offset + t) * 3;
+                uint32_t tv[3] = {verts[lt[0]], verts[lt[1]], verts[lt[2]]};
+                auto n = triangle_normal(mesh.positions, tv);
+                if (auto l = n.length(); l > 0.f) min_dot = std::min(min_dot, dot(m.cone_axis, n / l));
+            }
+        } else {
+            min_dot = -1.f;
+        }
+        m.cone_cutoff = min_dot <= 0.f ? 1.f : std::sqrt(1.f - min_dot * min_dot);
+        set.meshlets.push_back(m);
+    };
+
+    auto new_vertices = [&](const uint32_t* tv) {
+        return int(local[tv[0]] < 0) + int(local[tv[1]] < 0 && tv[1] != tv[0]) +
+               int(local[tv[2]] < 0 && tv[2] != tv[0] && tv[2] != tv[1]);
+    };
+
+    Meshlet cur{};
+    size_t cursor = 0; // seed of the next meshlet, in index order
+    for (size_t done = 0; done < tri_count; done++) {
+        // grow from the triangles around the meshlet, fewest new vertices first
+        // and among those the ones closest to the meshlet normal, which keeps the cone narrow
+        size_t best = tri_count;
+        float best_score = 0.f;
+        const vec3 axis = cur.cone_axis.length() > 0.f ? cur.cone_axis.normalized() : vec3{};
+        for (uint32_t i = 0; i < cur.vertex_count; i++) {
+            auto v = set.vertices[cur.vertex_offset + i];
+            auto row = adj.triangles.data() + adj.offsets[v];
+            for (uint32_t k = 0; k < adj.counts[v]; k++) {
+                auto t = row[k];
+                if (emitted[t]) continue;
+                auto added = new_vertices(indices.data() + t * 3);
+                if (cur.vertex_count + added > max_vertices) continue;
+                float score = (float)added + .5f * (1.f - dot(axis, normals[t]));
+                if (best == tri_count || score < best_score) best = t, best_score = score;
+            }
+        }
+
+        if (best == tri_count || cur.triangle_count == max_triangles) {
+            if (cur.triangle_count > 0) {
+                finish(cur);
+                cur = {};
+                cur.vertex_offset = (uint32_t)set.vertices.size();
+                cur.triangle_offset = (uint32_t)(set.triangles.size() / 3);
+            }
+            if (best == tri_count) { // a full meshlet seeds the next with its best neighbor
+                while (emitted[cursor]) ++cursor;
+                best = cursor;
+            }
+        }
+
+        emitted[best] = 1;
+        const uint32_t* tv = indices.data() + best * 3;
+        for (int k = 0; k < 3; k++) {
+            auto& l = local[tv[k]];
+            if (l < 0) {
+                l = (int)cur.vertex_count++;
+                set.vertices.push_back(tv[k]);
+            }
+            set.triangles.push_back((uint8_t)l);
+        }
+        cur.cone_axis += normals[best]; // summed while growing, normalized by finish
+        cur.triangle_count++;
+    }
+    if (cur.triangle_count > 0) finish(cur);
+    return set;
+}
+
+}
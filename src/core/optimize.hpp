@@ -0,0 +1,53 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "mesh.hpp"
+
+namespace cu {
+
+// preprocessing of triangle lists, restarts are only allowed by optimize_vertex_fetch
+// normals are taken from the counter clockwise winding
+
+// Forsyth's linear-speed vertex cache optimisation, reorders the triangles
+void optimize_vertex_cache(IndexedMesh& mesh, int cache_size = 32);
+
+// vertices transformed per triangle with a FIFO post transform cache, 0.5 at best and 3 at worst
+[[nodiscard]] float average_cache_miss_ratio(const MeshView& mesh, int cache_size = 16);
+
+// view independent overdraw ordering (Sander et al., Tipsify), run after optimize_vertex_cache
+// the triangles are split into clusters whose cache efficiency stays within threshold of the original
+// and the clusters facing outward of the mesh are drawn first, so they tend to occlude the rest
+void optimize_overdraw(IndexedMesh& mesh, float threshold = 1.05f, int cache_size = 16);
+
+// renumbers the vertices in order of first use, unreferenced ones are dropped
+void optimize_vertex_fetch(IndexedMesh& mesh);
+
+struct Meshlet {
+    uint32_t vertex_offset, vertex_count;     // into MeshletSet::vertices
+    uint32_t triangle_offset, triangle_count; // into MeshletSet::triangles, in triangles
+
+    // bounding sphere
+    vec3 center;
+    float radius;
+    // every triangle normal is within the cone, cutoff is the sine of its half angle
+    // 1 if the normals spread over more than a half sphere
+    vec3 cone_axis;
+    float cone_cutoff;
+
+    // true if all triangles face away from a camera at pos
+    [[nodiscard]] bool backfacing(const vec3& camera_position) const;
+};
+
+struct MeshletSet {
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices; // mesh vertex of every meshlet vertex
+    std::vector<uint8_t> triangles; // three meshlet vertices per triangle
+};
+
+// meshlets grow greedily over shared vertices, max_vertices is at most 256
+[[nodiscard]] MeshletSet build_meshlets(const MeshView& mesh, size_t max_vertices = 64, size_t max_triangles = 124);
+
+}
@@ -0,0 +1,61 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "sethread.h"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+namespace cu {
+
+// runs fn(i) for every i in [0, n), the calling thread works along with up to `helpers` tasks of the pool
+// indices are claimed dynamically. helpers which haven't started when the caller ran out of work are
+// cancelled, so a busy pool, or a caller running on one of its workers, can't stall the call
+template <class F>
+void parallel_for(st::ThreadPool* pool, int helpers, int n, F&& fn) {
+    helpers = pool ? std::min(helpers, n - 1) : 0;
+    if (helpers <= 0) {
+        for (int i = 0; i < n; i++) fn(i);
+        return;
+    }
+
+    // shared with the queued tasks, which may outlive the call
+    struct State {
+        std::atomic_int next = 0;
+        std::mutex mutex;
+        int running = 0;
+        bool closed = false;
+    };
+    auto state = std::make_shared<State>();
+    auto work = [&] {
+        for (int i; (i = state->next.fetch_add(1)) < n;) fn(i);
+    };
+    for (int h = 0; h < helpers; h++)
+        pool->addTask([state, &work] {
+            {
+                std::lock_guard lock{state->mutex};
+                if (state->closed) return; // the call is over, `work` is gone
+                ++state->running;
+            }
+            work();
+            std::lock_guard lock{state->mutex};
+            --state->running;
+        });
+    work();
+
+    std::unique_lock lock{state->mutex};
+    state->closed = true;
+    while (state->running) { // only helpers which took an index are left
+        lock.unlock();
+        std::this_thread::yield();
+        lock.lock();
+    }
+}
+
+}
@@ -0,0 +1,178 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "resample.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+namespace cu {
+
+namespace {
+
+// acc[4 * i + c] += row[i][c]
+void accumulate_row(const ColorU32* row, uint32_t* acc, int n) {
+    int i = 0;
+#ifdef CU_ENABLED_SIMD
+    const auto z = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        auto lo = _mm_unpacklo_epi8(p, z), hi = _mm_unpackhi_epi8(p, z);
+        auto a = reinterpret_cast<__m128i*>(acc + i * 4);
+        _mm_storeu_si128(a + 0, _mm_add_epi32(_mm_loadu_si128(a + 0), _mm_unpacklo_epi16(lo, z)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, z)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, z)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, z)));
+    }
+#endif
+    for (; i < n; i++)
+        for (int c = 0; c < 4; c++) acc[i * 4 + c] += row[i][c];
+}
+
+// sum of n accumulated pixels divided by count, rounded
+ColorU32 resolve(const uint32_t* acc, int n, uint32_t count) {
+#ifdef CU_ENABLED_SIMD
+    auto s = _mm_setzero_si128();
+    for (int i = 0; i < n; i++)
+        s = _mm_add_epi32(s, _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i * 4)));
+    auto f = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(1.f / (float)count)), _mm_set1_ps(.5f));
+    auto v = _mm_cvttps_epi32(f);
+    v = _mm_packs_epi32(v, v);
+    return std::bit_cast<ColorU32>(_mm_cvtsi128_si32(_mm_packus_epi16(v, v)));
+#else
+    uint32_t s[4]{};
+    for (int i = 0; i < n; i++)
+        for (int c = 0; c < 4; c++) s[c] += acc[i * 4 + c];
+    ColorU32 r;
+    for (int c = 0; c < 4; c++) r[c] = (uint8_t)((s[c] + count / 2) / count);
+    return r;
+#endif
+}
+
+// [b, e) of destination pixel i when n source pixels starting at o are split into m
+std::pair<int, int> footprint(int i, int o, int n, int m) {
+    int b = o + (int)((int64_t)i * n / m);
+    int e = o + (int)((int64_t)(i + 1) * n / m);
+    return {b, std::max(e, b + 1)};
+}
+
+// the two source pixels i, i + 1 of a destination pixel, w in 0..256 is the weight of i + 1
+struct Tap {
+    int i, w;
+};
+
+void make_taps(std::vector<Tap>& taps, int m, int o, int n, Filter filter) {
+    taps.resize(m);
+    const float ratio = (float)n / (float)m;
+    for (int d = 0; d < m; d++) {
+        float i, w;
+        if (filter == Filter::bilinear) {
+            auto u = ((float)d + .5f) * ratio - .5f;
+            i = std::floor(u), w = u - i;
+        } else {
+            // [a, b) covers at most pixels i and i + 1 when enlarging
+            auto a = (float)d * ratio, b = a + ratio;
+            i = std::floor(a);
+            w = b > i + 1.f ? std::min((b - i - 1.f) / ratio, 1.f) : 0.f;
+        }
+        int k = std::clamp((int)i, 0, n - 1);
+        int wi = k + 1 < n && i >= 0.f ? (int)std::lround(w * 256.f) : 0;
+        taps[d] = {o + k, wi};
+    }
+}
+
+// out[x] = lerp(a[x], b[x], w / 256) per channel
+void lerp_row(const ColorU32* a, const ColorU32* b, int w, ColorU32* out, int n) {
+    int x = 0;
+#ifdef CU_ENABLED_SIMD
+    const auto z = _mm_setzero_si128();
+    const auto wa = _mm_set1_epi16((short)(256 - w)), wb = _mm_set1_epi16((short)w);
+    const auto half = _mm_set1_epi16(128);
+    for (; x + 4 <= n; x += 4) {
+        auto pa = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+        auto pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+        auto lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pa, z), wa), _mm_mullo_epi16(_mm_unpacklo_epi8(pb, z), wb));
+        auto hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pa, z), wa), _mm_mullo_epi16(_mm_unpackhi_epi8(pb, z), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < n; x++)
+        for (int c = 0; c < 4; c++)
+            out[x][c] = (uint8_t)((a[x][c] * (256 - w) + b[x][c] * w + 128) >> 8);
+}
+
+// out[d] = lerp(row[i], row[i + 1], w / 256) of tap d, row must hold one pixel past the last tap
+void lerp_taps(const ColorU32* row, const Tap* taps, ColorU32* out, int n) {
+#ifdef CU_ENABLED_SIMD
+    const auto z = _mm_setzero_si128();
+    const auto half = _mm_set1_epi32(128);
+    for (int d = 0; d < n; d++) {
+        auto [i, w] = taps[d];
+        auto p = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + i)), z);
+        // channels of both pixels side by side, one madd weighs them
+        auto ab = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+        auto v = _mm_madd_epi16(ab, _mm_set1_epi32(w << 16 | (256 - w)));
+        v = _mm_srli_epi32(_mm_add_epi32(v, half), 8);
+        v = _mm_packs_epi32(v, v);
+        out[d] = std::bit_cast<ColorU32>(_mm_cvtsi128_si32(_mm_packus_epi16(v, v)));
+    }
+#else
+    for (int d = 0; d < n; d++) {
+        auto [i, w] = taps[d];
+        for (int c = 0; c < 4; c++)
+            out[d][c] = (uint8_t)((row[i][c] * (256 - w) + row[i + 1][c] * w + 128) >> 8);
+    }
+#endif
+}
+
+}
+
+void downsample_area(const ImageRGBA8& src, const Rect& src_rect, ImageRGBA8& dst) {
+    auto r = src_rect.intersect({0, 0, src.size_.x, src.size_.y});
+    auto [dw, dh] = dst.size_.asArray;
+    if (r.empty() || dw <= 0 || dh <= 0) return;
+
+    thread_local std::vector<uint32_t> acc;
+    acc.resize(r.w * 4);
+    for (int dy = 0; dy < dh; dy++) {
+        auto [y0, y1] = footprint(dy, r.y, r.h, dh);
+        std::fill(acc.begin(), acc.end(), 0);
+        for (int y = y0; y < y1; y++)
+            accumulate_row(src.row(y) + r.x, acc.data(), r.w);
+
+        auto out = dst.row(dy);
+        for (int dx = 0; dx < dw; dx++) {
+            auto [x0, x1] = footprint(dx, 0, r.w, dw);
+            out[dx] = resolve(acc.data() + x0 * 4, x1 - x0, (uint32_t)((x1 - x0) * (y1 - y0)));
+        }
+    }
+}
+
+void resample(const ImageRGBA8& src, const Rect& src_rect, ImageRGBA8& dst, Filter filter) {
+    auto r = src_rect.intersect({0, 0, src.size_.x, src.size_.y});
+    auto [dw, dh] = dst.size_.asArray;
+    if (r.empty() || dw <= 0 || dh <= 0) return;
+    if (filter == Filter::area && dw <= r.w && dh <= r.h)
+        return downsample_area(src, r, dst);
+
+    // separable: the two source rows are blended first, then pairs of columns
+    thread_local std::vector<Tap> tx, ty;
+    thread_local std::vector<ColorU32> blended;
+    make_taps(tx, dw, 0, r.w, filter);
+    make_taps(ty, dh, r.y, r.h, filter);
+    blended.resize(r.w + 1);
+    for (int dy = 0; dy < dh; dy++) {
+        auto [y, wy] = ty[dy];
+        auto r0 = src.row(y) + r.x;
+        lerp_row(r0, wy ? src.row(y + 1) + r.x : r0, wy, blended.data(), r.w);
+        blended[r.w] = blended[r.w - 1];
+
+        lerp_taps(blended.data(), tx.data(), dst.row(dy), dw);
+    }
+}
+
+}
@@ -0,0 +1,24 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "core.hpp"
+
+namespace cu {
+
+// box filter, every destination pixel is the average of the source pixels it covers
+// the footprints are rounded to whole source pixels, meant for reducing (an integer ratio is exact)
+// rendering at N times the destination size and reducing is N x N supersampling
+void downsample_area(const ImageRGBA8& src, const Rect& src_rect, ImageRGBA8& dst);
+
+enum class Filter {
+    bilinear,
+    area // reduces like downsample_area, enlarges by the coverage of at most two source pixels per axis
+};
+
+// stretches src_rect of src over the whole dst
+void resample(const ImageRGBA8& src, const Rect& src_rect, ImageRGBA8& dst, Filter filter);
+
+}
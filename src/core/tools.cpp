@@ -6,8 +6,11 @@
 //
 
 #include "tools.hpp"
+#include "calcu.hpp"
 
+#include <cmath>
 #include <thread>
+#include <algorithm>
 
 namespace cu {
 
@@ -35,8 +38,136 @@ float GetColorFeatureValue(const mathpls::vec4& color, ColorFeature feature) {
 FLatch::FLatch(const cu::FLatch::dt &time)
     : end(std::chrono::high_resolution_clock::now() + time) {}
 
+void sleep_until_precise(std::chrono::steady_clock::time_point deadline, std::chrono::nanoseconds& margin) {
+    using namespace std::chrono;
+    constexpr nanoseconds min_margin = microseconds{200}, max_margin = milliseconds{4};
+    for (;;) {
+        auto now = steady_clock::now();
+        auto sleep = deadline - now - margin;
+        if (sleep <= nanoseconds::zero()) break;
+        std::this_thread::sleep_for(sleep);
+        auto over = duration_cast<nanoseconds>(steady_clock::now() - now - sleep);
+        // jump up to a larger oversleep at once, decay slowly
+        margin = over > margin ? over : margin - (margin - over) / 16;
+        margin = std::clamp(margin, min_margin, max_margin);
+    }
+    while (steady_clock::now() < deadline) {
+#ifdef CU_ENABLED_SIMD
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+}
+
 FLatch::~FLatch() {
-    std::this_thread::sleep_until(end);
+    thread_local std::chrono::nanoseconds margin{std::chrono::microseconds{500}};
+    auto left = end - std::chrono::high_resolution_clock::now();
+    sleep_until_precise(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::nanoseconds>(left), margin);
+}
+
+FramePacer::FramePacer(double fps) {
+    set_rate(fps);
+    last = clock::now();
+    deadline = last + interval;
+}
+
+bool FramePacer::wait() {
+    auto now = clock::now();
+    auto work = now - last;
+    bool on_time = now <= deadline;
+    if (on_time) {
+        sleep_until_precise(deadline, margin);
+        deadline += interval;
+    } else {
+        ++missed_count;
+        // more than a period behind, the lost slots are dropped
+        deadline = now - deadline > interval ? now + interval : deadline + interval;
+    }
+
+    auto t = clock::now();
+    history[frames++ % window] = t - last;
+    last = t;
+
+    auto frame_load = (float)work.count() / (float)interval.count();
+    smoothed_load += (frame_load - smoothed_load) * .1f;
+    // pixels scale with the square, the load is also smoothed as if the frame had been drawn at full scale,
+    // so frames of older scales in the average don't make the correction compound
+    auto s = render_scale();
+    full_load += (frame_load / (s * s) - full_load) * .1f;
+    if (adaptive) {
+        // aim for 80% of the period and leave a dead band around it
+        auto expected = full_load * scale * scale;
+        if (expected > .9f || expected < .65f)
+            scale = std::clamp(std::sqrt(.8f / std::max(full_load, .01f)), min_scale, 1.f);
+    }
+    return on_time;
+}
+
+bool FramePacer::should_present() {
+    if (!skip_late) return true;
+    presented = clock::now() <= deadline || !presented;
+    return presented;
+}
+
+float FramePacer::render_scale() const {
+    return adaptive ? scale : 1.f;
+}
+
+FramePacer& FramePacer::set_rate(double fps) {
+    interval = std::chrono::duration_cast<dt>(std::chrono::duration<double>(1. / fps));
+    return *this;
+}
+
+FramePacer& FramePacer::set_skip_late(bool enable) {
+    skip_late = enable;
+    return *this;
+}
+
+FramePacer& FramePacer::set_adaptive(bool enable, float min) {
+    adaptive = enable;
+    min_scale = min;
+    scale = std::max(scale, min);
+    return *this;
+}
+
+FramePacer::dt FramePacer::period() const {
+    return interval;
+}
+
+FramePacer::dt FramePacer::percentile(float p) const {
+    auto n = std::min(frames, window);
+    if (n == 0) return {};
+    auto sorted = history;
+    auto k = sorted.begin() + std::min((size_t)(p * (float)n), n - 1);
+    std::nth_element(sorted.begin(), k, sorted.begin() + n);
+    return *k;
+}
+
+FramePacer::dt FramePacer::p50() const {
+    return percentile(.5f);
+}
+
+FramePacer::dt FramePacer::p99() const {
+    return percentile(.99f);
+}
+
+FramePacer::dt FramePacer::jitter(float p) const {
+    auto n = std::min(frames, window);
+    if (n == 0) return {};
+    auto dev = history;
+    for (size_t i = 0; i < n; i++) dev[i] = dev[i] > interval ? dev[i] - interval : interval - dev[i];
+    auto k = dev.begin() + std::min((size_t)(p * (float)n), n - 1);
+    std::nth_element(dev.begin(), k, dev.begin() + n);
+    return *k;
+}
+
+float FramePacer::load() const {
+    return smoothed_load;
+}
+
+size_t FramePacer::missed() const {
+    return missed_count;
 }
 
 }
@@ -9,6 +9,7 @@
 
 #include "math_helper.h"
 
+#include <array>
 #include <chrono>
 
 namespace cu {
@@ -20,6 +21,11 @@ enum class ColorFeature {
 
 float GetColorFeatureValue(const Color& color, ColorFeature feature);
 
+// sleeps until `margin` before the deadline and spins the rest
+// margin follows the oversleep the OS shows, so it grows on loaded hosts and decays back
+void sleep_until_precise(std::chrono::steady_clock::time_point deadline, std::chrono::nanoseconds& margin);
+
+// waits out the time in the destructor, FramePacer keeps a steady rate across frames
 struct FLatch {
     using tp = std::chrono::high_resolution_clock::time_point;
     using dt = std::chrono::high_resolution_clock::duration;
@@ -30,4 +36,56 @@ struct FLatch {
     tp end;
 };
 
+// paces a loop to a fixed rate
+// deadlines advance by whole periods, so a late frame is caught up by the next one instead of shifting the phase
+class FramePacer {
+public:
+    using clock = std::chrono::steady_clock;
+    using tp = clock::time_point;
+    using dt = clock::duration;
+
+    static constexpr size_t window = 256; // frames kept for the statistics
+
+    explicit FramePacer(double fps = 60.);
+
+    // call once per frame after presenting, waits for the deadline of the frame
+    // false when it was already missed
+    bool wait();
+
+    // false when the frame is already late and presenting it should be skipped, never twice in a row
+    // the answer is remembered, ask once per frame
+    [[nodiscard]] bool should_present();
+    // suggested render resolution scale, 1 unless adaptive
+    [[nodiscard]] float render_scale() const;
+
+    FramePacer& set_rate(double fps);
+    FramePacer& set_skip_late(bool enable);
+    // the scale follows the work time, which is assumed to be proportional to the pixel count
+    FramePacer& set_adaptive(bool enable, float min_scale = .5f);
+
+    [[nodiscard]] dt period() const;
+    // frame to frame intervals over the window
+    [[nodiscard]] dt percentile(float p) const;
+    [[nodiscard]] dt p50() const;
+    [[nodiscard]] dt p99() const;
+    // deviation of the intervals from the period
+    [[nodiscard]] dt jitter(float p = .99f) const;
+    // work time / period, smoothed
+    [[nodiscard]] float load() const;
+    [[nodiscard]] size_t missed() const;
+
+private:
+    dt interval;
+    tp deadline, last;
+    std::chrono::nanoseconds margin{std::chrono::microseconds{500}};
+
+    std::array<dt, window> history{};
+    size_t frames = 0, missed_count = 0;
+
+    bool skip_late = false, presented = true;
+    bool adaptive = false;
+    float min_scale = .5f, scale = 1.f, smoothed_load = 0.f;
+    float full_load = 0.f; // smoothed load scaled back to a render scale of 1
+};
+
 }
@@ -32,35 +32,15 @@ GuiCanvas::~GuiCanvas() {
     CloseWindow();
 }
 
-Image* GuiCanvas::clone() const {
-    assert(false && "Not allowed to clone!");
-}
+GuiCanvas::GuiCanvas(const Extent& size)
+    : GuiCanvas(GenImageColor(size.x, size.y, ::GRAY)) {}
 
-GuiCanvas::GuiCanvas(const Extent& size) {
-    img = GenImageColor(size.x, size.y, ::GRAY);
+GuiCanvas::GuiCanvas(const ::Image& image)
+    : ImageRGBA8({image.width, image.height}, static_cast<ColorU32*>(image.data), image.width * sizeof(ColorU32)),
+      img(image) {
     tex = LoadTextureFromImage(img);
 }
 
-
-Extent GuiCanvas::size() const {
-    return {GetScreenWidth(), GetScreenHeight()};
-}
-
-Color GuiCanvas::get(uivec2 pos) const {
-    ::Color c = GetImageColor(img, (int)pos.x, (int)pos.y);
-    return vec4(c.r, c.g, c.b, c.a) / 255.0f;
-}
-
-void GuiCanvas::set(uivec2 pos, const Color& color) {
-    ColorU32 c = color;
-    ImageDrawPixel(&img, (int)pos.x, (int)pos.y, {c.r, c.g, c.b, c.a});
-}
-
-void GuiCanvas::clear(const Color& clear_color) {
-    ColorU32 c = clear_color;
-    ImageClearBackground(&img, {c.r, c.g, c.b, c.a});
-}
-
 void GuiCanvas::show() const {
     UpdateTexture(tex, img.data);
     BeginDrawing();
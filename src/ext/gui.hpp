@@ -15,7 +15,8 @@ struct GuiInitInfo {
     const char* title{};
 };
 
-struct GuiCanvas : public Image {
+// renders straight into the raylib image memory
+struct GuiCanvas : public ImageRGBA8 {
     static void init(const GuiInitInfo& info);
     static bool window_should_close();
 
@@ -23,12 +24,6 @@ struct GuiCanvas : public Image {
 
     ~GuiCanvas() override;
     GuiCanvas(GuiCanvas&&) = delete;
-    [[nodiscard]] Image* clone() const override;
-
-    [[nodiscard]] Extent size() const override;
-    [[nodiscard]] Color get(uivec2 pos) const override;
-    void set(uivec2 pos, const Color& color) override;
-    void clear(const Color& clear_color) override;
 
     void show() const;
 
@@ -37,6 +32,7 @@ struct GuiCanvas : public Image {
 
 private:
     explicit GuiCanvas(const Extent& size);
+    explicit GuiCanvas(const ::Image& image);
 
     static inline std::shared_ptr<GuiCanvas> obj = nullptr;
 };
@@ -9,6 +9,7 @@
 
 #include "mathpls.h"
 
+#include <bit>
 #include <cstdint>
 #include <algorithm>
 
@@ -10,6 +10,7 @@ namespace cu {
 
 thread_local std::vector<std::pair<ivec2, float>> AsyncPipeline::dep_buf{};
 thread_local std::vector<std::pair<ivec2, Color>> AsyncPipeline::col_buf{};
+thread_local std::vector<std::pair<ivec2, ColorU32>> AsyncPipeline::packed_buf{};
 
 AsyncPipeline::AsyncPipeline(st::ThreadPool* tp, const PipelineInitInfo& info)
     : Pipeline(info), tp(tp) {}
@@ -28,13 +29,16 @@ void AsyncPipeline::draw_buf() {
         for (auto&& [p, z] : dep_buf)
             write_depth(p, z);
     }
-    if (!col_buf.empty()) {
+    if (!col_buf.empty() || !packed_buf.empty()) {
         std::unique_lock lock{col_mutex};
         for (auto&& [p, c] : col_buf)
             Pipeline::set_color(p, c);
+        for (auto&& [p, c] : packed_buf)
+            Pipeline::set_packed_color(p, c);
     }
     dep_buf.clear();
     col_buf.clear();
+    packed_buf.clear();
 }
 
 void AsyncPipeline::draw_point(const Vertex& point) {
@@ -64,19 +68,66 @@ void AsyncPipeline::draw_triangle(const std::array<Vertex, 3>& vertices) {
     });
 }
 
+void AsyncPipeline::submit_point(const Vertex& vertex) {
+    ++remain_tasks;
+    tp_or_assert().addTask([=, this] {
+        assemble_point(vertex);
+        draw_buf();
+        --remain_tasks;
+    });
+}
+
+void AsyncPipeline::submit_line(const std::array<Vertex, 2>& vertices) {
+    ++remain_tasks;
+    tp_or_assert().addTask([=, this] {
+        assemble_line(vertices);
+        draw_buf();
+        --remain_tasks;
+    });
+}
+
+void AsyncPipeline::submit_triangle(const std::array<Vertex, 3>& vertices) {
+    ++remain_tasks;
+    tp_or_assert().addTask([=, this] {
+        assemble_triangle(vertices);
+        draw_buf();
+        --remain_tasks;
+    });
+}
+
+void AsyncPipeline::replay_prepass() {
+    constexpr size_t batch = 64;
+
+    auto& list = prepass_list();
+    ++remain_tasks;
+    tp_or_assert().addTask([&list, this] {
+        for (auto&& i : list.points)
+            fragment_shader_callback(i);
+        for (auto&& i : list.lines)
+            rast_draw_line(i);
+        draw_buf();
+        --remain_tasks;
+    });
+
+    std::span<const std::array<Vertex, 3>> triangles = list.triangles;
+    for (size_t b = 0; b < triangles.size(); b += batch) {
+        auto part = triangles.subspan(b, std::min(batch, triangles.size() - b));
+        ++remain_tasks;
+        tp_or_assert().addTask([part, this] {
+            for (auto&& i : part)
+                rast_draw_triangle(i);
+            draw_buf();
+            --remain_tasks;
+        });
+    }
+}
+
 bool AsyncPipeline::depth_test(ivec2 pos, float z) {
     if (!depth_test_enabled())
         return true; // haven't been enabled
 
-    float depth = 1.f / z; {
-        std::shared_lock lock{dep_mutex};
-        if (check_depth(pos, depth))
-            return false; // failed
-    }
-
-    if (depth_write_enabled())
-        dep_buf.emplace_back(pos, depth);
-    return true; // passed
+    std::shared_lock lock{dep_mutex};
+    return check_depth(pos, to_depth(z));
 }
 
 void AsyncPipeline::blend_color(ivec2 pos, Color& color) {
@@ -84,10 +135,38 @@ void AsyncPipeline::blend_color(ivec2 pos, Color& color) {
     Pipeline::blend_color(pos, color);
 }
 
+void AsyncPipeline::blend_packed_color(ivec2 pos, ColorU32& color) {
+    std::shared_lock lock{col_mutex};
+    Pipeline::blend_packed_color(pos, color);
+}
+
 void AsyncPipeline::set_color(ivec2 pos, const Color& color) {
     col_buf.emplace_back(pos, color);
 }
 
+void AsyncPipeline::set_packed_color(ivec2 pos, ColorU32 color) {
+    packed_buf.emplace_back(pos, color);
+}
+
+size_t AsyncPipeline::depth_test_span(ivec2 pos, const float* depth, uint8_t* mask, int n) {
+    std::shared_lock lock{dep_mutex};
+    return Pipeline::depth_test_span(pos, depth, mask, n);
+}
+
+void AsyncPipeline::store_depth(ivec2 pos, float z) {
+    dep_buf.emplace_back(pos, z);
+}
+
+void AsyncPipeline::write_color_span(ivec2 pos, const ColorU32* colors, const uint8_t* mask, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!mask[i]) continue;
+        auto c = colors[i];
+        if (blend_enabled())
+            blend_packed_color({pos.x + i, pos.y}, c);
+        set_packed_color({pos.x + i, pos.y}, c);
+    }
+}
+
 void AsyncPipeline::finish() const {
     while (remain_tasks != 0)
         std::this_thread::yield();
@@ -23,12 +23,24 @@ public:
     void draw_line(const std::array<Vertex, 2>& vertices) override;
     void draw_triangle(const std::array<Vertex, 3>& vertices) override;
 
-    void finish() const;
+    void finish() const override;
 
 protected:
+    void submit_point(const Vertex& vertex) override;
+    void submit_line(const std::array<Vertex, 2>& vertices) override;
+    void submit_triangle(const std::array<Vertex, 3>& vertices) override;
+
+    void replay_prepass() override;
+
     [[nodiscard]] bool depth_test(ivec2 pos, float z) override;
     void blend_color(ivec2 pos, Color& color) override;
+    void blend_packed_color(ivec2 pos, ColorU32& color) override;
     void set_color(ivec2 pos, const Color& color) override;
+    void set_packed_color(ivec2 pos, ColorU32 color) override;
+
+    [[nodiscard]] size_t depth_test_span(ivec2 pos, const float* depth, uint8_t* mask, int n) override;
+    void store_depth(ivec2 pos, float z) override;
+    void write_color_span(ivec2 pos, const ColorU32* colors, const uint8_t* mask, int n) override;
 
 private:
     st::ThreadPool* tp{};
@@ -38,6 +50,7 @@ private:
 
     static thread_local std::vector<std::pair<ivec2, float>> dep_buf;
     static thread_local std::vector<std::pair<ivec2, Color>> col_buf;
+    static thread_local std::vector<std::pair<ivec2, ColorU32>> packed_buf;
 
 };
 
@@ -0,0 +1,241 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "blend.hpp"
+
+#include <cstring>
+
+namespace cu {
+
+BlendState BlendState::alpha() {
+    return {};
+}
+
+BlendState BlendState::premultiplied() {
+    return {BlendFactor::one, BlendFactor::one_minus_src_alpha, BlendOp::add,
+            BlendFactor::one, BlendFactor::one_minus_src_alpha, BlendOp::add};
+}
+
+BlendState BlendState::additive() {
+    return {BlendFactor::one, BlendFactor::one, BlendOp::add,
+            BlendFactor::one, BlendFactor::one, BlendOp::add};
+}
+
+BlendState BlendState::multiply() {
+    return {BlendFactor::dst_color, BlendFactor::zero, BlendOp::add,
+            BlendFactor::dst_alpha, BlendFactor::zero, BlendOp::add};
+}
+
+BlendState BlendState::min() {
+    return {BlendFactor::one, BlendFactor::one, BlendOp::min,
+            BlendFactor::one, BlendFactor::one, BlendOp::min};
+}
+
+BlendState BlendState::max() {
+    return {BlendFactor::one, BlendFactor::one, BlendOp::max,
+            BlendFactor::one, BlendFactor::one, BlendOp::max};
+}
+
+namespace {
+
+// a * b / 255, correctly rounded for a, b in [0, 255]
+constexpr uint32_t mul255(uint32_t a, uint32_t b) {
+    auto x = a * b + 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+uint32_t factor(BlendFactor f, const ColorU32& s, const ColorU32& d, int ch) {
+    switch (f) {
+        case BlendFactor::zero:                return 0;
+        case BlendFactor::one:                 return 255;
+        case BlendFactor::src_color:           return s[ch];
+        case BlendFactor::one_minus_src_color: return 255 - s[ch];
+        case BlendFactor::dst_color:           return d[ch];
+        case BlendFactor::one_minus_dst_color: return 255 - d[ch];
+        case BlendFactor::src_alpha:           return s.a;
+        case BlendFactor::one_minus_src_alpha: return 255 - s.a;
+        case BlendFactor::dst_alpha:           return d.a;
+        case BlendFactor::one_minus_dst_alpha: return 255 - d.a;
+        default: return 0;
+    }
+}
+
+uint8_t combine(BlendOp op, uint32_t s, uint32_t d, uint32_t fs, uint32_t fd) {
+    auto a = (int)mul255(s, fs), b = (int)mul255(d, fd);
+    switch (op) {
+        case BlendOp::add:              return std::min(a + b, 255);
+        case BlendOp::subtract:         return std::max(a - b, 0);
+        case BlendOp::reverse_subtract: return std::max(b - a, 0);
+        case BlendOp::min:              return std::min(s, d);
+        case BlendOp::max:              return std::max(s, d);
+        default: return 0;
+    }
+}
+
+ColorU32 blend_scalar(const BlendState& st, const ColorU32& s, const ColorU32& d) {
+    ColorU32 r;
+    for (int c = 0; c < 3; c++)
+        r[c] = combine(st.color_op, s[c], d[c], factor(st.src_color, s, d, c), factor(st.dst_color, s, d, c));
+    r.a = combine(st.alpha_op, s.a, d.a, factor(st.src_alpha, s, d, 3), factor(st.dst_alpha, s, d, 3));
+    return r;
+}
+
+enum class Kernel {
+    alpha,
+    premultiplied,
+    additive,
+    multiply,
+    min,
+    max,
+    generic
+};
+
+Kernel select_kernel(const BlendState& st) {
+    if (st == BlendState::alpha()) return Kernel::alpha;
+    if (st == BlendState::premultiplied()) return Kernel::premultiplied;
+    if (st == BlendState::additive()) return Kernel::additive;
+    if (st == BlendState::multiply()) return Kernel::multiply;
+    if (st.color_op == BlendOp::min && st.alpha_op == BlendOp::min) return Kernel::min;
+    if (st.color_op == BlendOp::max && st.alpha_op == BlendOp::max) return Kernel::max;
+    return Kernel::generic;
+}
+
+#ifdef CU_ENABLED_SIMD
+
+// all 16-bit helpers below work on 2 pixels (8 channels) widened from bytes
+
+inline __m128i mm_mul255(__m128i a, __m128i b) {
+    auto x = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+inline __m128i mm_alpha(__m128i c) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xFF), 0xFF);
+}
+
+inline __m128i mm_inv(__m128i c) {
+    return _mm_sub_epi16(_mm_set1_epi16(255), c);
+}
+
+inline __m128i mm_alpha_mask() {
+    return _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+}
+
+__m128i mm_factor(BlendFactor f, __m128i s, __m128i d, __m128i sa, __m128i da) {
+    switch (f) {
+        case BlendFactor::zero:                return _mm_setzero_si128();
+        case BlendFactor::one:                 return _mm_set1_epi16(255);
+        case BlendFactor::src_color:           return s;
+        case BlendFactor::one_minus_src_color: return mm_inv(s);
+        case BlendFactor::dst_color:           return d;
+        case BlendFactor::one_minus_dst_color: return mm_inv(d);
+        case BlendFactor::src_alpha:           return sa;
+        case BlendFactor::one_minus_src_alpha: return mm_inv(sa);
+        case BlendFactor::dst_alpha:           return da;
+        case BlendFactor::one_minus_dst_alpha: return mm_inv(da);
+        default: return _mm_setzero_si128();
+    }
+}
+
+__m128i mm_combine(BlendOp op, __m128i s, __m128i d, __m128i fs, __m128i fd) {
+    switch (op) {
+        case BlendOp::add:              return _mm_adds_epu16(mm_mul255(s, fs), mm_mul255(d, fd));
+        case BlendOp::subtract:         return _mm_subs_epu16(mm_mul255(s, fs), mm_mul255(d, fd));
+        case BlendOp::reverse_subtract: return _mm_subs_epu16(mm_mul255(d, fd), mm_mul255(s, fs));
+        case BlendOp::min:              return _mm_min_epi16(s, d);
+        case BlendOp::max:              return _mm_max_epi16(s, d);
+        default: return _mm_setzero_si128();
+    }
+}
+
+__m128i mm_blend_generic(const BlendState& st, __m128i s, __m128i d) {
+    auto sa = mm_alpha(s), da = mm_alpha(d);
+    auto fs = mm_factor(st.src_color, s, d, sa, da);
+    auto fd = mm_factor(st.dst_color, s, d, sa, da);
+    if (st.src_alpha != st.src_color || st.dst_alpha != st.dst_color) {
+        auto m = mm_alpha_mask();
+        fs = _mm_or_si128(_mm_and_si128(m, mm_factor(st.src_alpha, s, d, sa, da)), _mm_andnot_si128(m, fs));
+        fd = _mm_or_si128(_mm_and_si128(m, mm_factor(st.dst_alpha, s, d, sa, da)), _mm_andnot_si128(m, fd));
+    }
+    auto r = mm_combine(st.color_op, s, d, fs, fd);
+    if (st.alpha_op != st.color_op) {
+        auto m = mm_alpha_mask();
+        r = _mm_or_si128(_mm_and_si128(m, mm_combine(st.alpha_op, s, d, fs, fd)), _mm_andnot_si128(m, r));
+    }
+    return r;
+}
+
+// blends 4 pixels
+template <Kernel K>
+__m128i mm_blend4(const BlendState& st, __m128i s, __m128i d) {
+    if constexpr (K == Kernel::additive) return _mm_adds_epu8(s, d);
+    if constexpr (K == Kernel::min) return _mm_min_epu8(s, d);
+    if constexpr (K == Kernel::max) return _mm_max_epu8(s, d);
+
+    auto half = [&](__m128i s, __m128i d) {
+        if constexpr (K == Kernel::alpha) {
+            auto sa = mm_alpha(s);
+            return _mm_add_epi16(mm_mul255(s, sa), mm_mul255(d, mm_inv(sa)));
+        } else if constexpr (K == Kernel::premultiplied) {
+            return _mm_add_epi16(s, mm_mul255(d, mm_inv(mm_alpha(s))));
+        } else if constexpr (K == Kernel::multiply) {
+            return mm_mul255(s, d);
+        } else {
+            return mm_blend_generic(st, s, d);
+        }
+    };
+    auto z = _mm_setzero_si128();
+    auto lo = half(_mm_unpacklo_epi8(s, z), _mm_unpacklo_epi8(d, z));
+    auto hi = half(_mm_unpackhi_epi8(s, z), _mm_unpackhi_epi8(d, z));
+    return _mm_packus_epi16(lo, hi);
+}
+
+template <Kernel K>
+void blend_kernel(const BlendState& st, const ColorU32* src, ColorU32* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), mm_blend4<K>(st, s, d));
+    }
+    if (i < n) { // tail goes through the same kernel to keep results identical
+        alignas(16) ColorU32 s[4]{}, d[4]{};
+        std::memcpy(s, src + i, (n - i) * sizeof(ColorU32));
+        std::memcpy(d, dst + i, (n - i) * sizeof(ColorU32));
+        auto r = mm_blend4<K>(st, _mm_load_si128(reinterpret_cast<const __m128i*>(s)),
+                                  _mm_load_si128(reinterpret_cast<const __m128i*>(d)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(d), r);
+        std::memcpy(dst + i, d, (n - i) * sizeof(ColorU32));
+    }
+}
+
+#else
+
+template <Kernel K>
+void blend_kernel(const BlendState& st, const ColorU32* src, ColorU32* dst, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = blend_scalar(st, src[i], dst[i]);
+}
+
+#endif
+
+}
+
+void blend_span(const BlendState& state, const ColorU32* src, ColorU32* dst, size_t n) {
+    switch (select_kernel(state)) {
+        case Kernel::alpha:         return blend_kernel<Kernel::alpha>(state, src, dst, n);
+        case Kernel::premultiplied: return blend_kernel<Kernel::premultiplied>(state, src, dst, n);
+        case Kernel::additive:      return blend_kernel<Kernel::additive>(state, src, dst, n);
+        case Kernel::multiply:      return blend_kernel<Kernel::multiply>(state, src, dst, n);
+        case Kernel::min:           return blend_kernel<Kernel::min>(state, src, dst, n);
+        case Kernel::max:           return blend_kernel<Kernel::max>(state, src, dst, n);
+        default:                    return blend_kernel<Kernel::generic>(state, src, dst, n);
+    }
+}
+
+ColorU32 blend_packed(const BlendState& state, ColorU32 src, ColorU32 dst) {
+    return blend_scalar(state, src, dst);
+}
+
+}
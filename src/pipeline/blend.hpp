@@ -0,0 +1,57 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "core.hpp"
+
+namespace cu {
+
+// GL-style naming: src is the incoming fragment, dst is the framebuffer
+enum class BlendFactor {
+    zero,
+    one,
+    src_color,
+    one_minus_src_color,
+    dst_color,
+    one_minus_dst_color,
+    src_alpha,
+    one_minus_src_alpha,
+    dst_alpha,
+    one_minus_dst_alpha
+};
+
+enum class BlendOp {
+    add,
+    subtract,         // src - dst
+    reverse_subtract, // dst - src
+    min,              // factors are ignored
+    max               // factors are ignored
+};
+
+struct BlendState {
+    BlendFactor src_color = BlendFactor::src_alpha;
+    BlendFactor dst_color = BlendFactor::one_minus_src_alpha;
+    BlendOp color_op = BlendOp::add;
+
+    BlendFactor src_alpha = BlendFactor::src_alpha;
+    BlendFactor dst_alpha = BlendFactor::one_minus_src_alpha;
+    BlendOp alpha_op = BlendOp::add;
+
+    static BlendState alpha();         // same as default_blend_func
+    static BlendState premultiplied(); // src + dst * (1 - src.a)
+    static BlendState additive();      // src + dst
+    static BlendState multiply();      // src * dst
+    static BlendState min();
+    static BlendState max();
+
+    bool operator==(const BlendState&) const = default;
+};
+
+// blends src over dst in place, common states are dispatched to specialized kernels
+void blend_span(const BlendState& state, const ColorU32* src, ColorU32* dst, size_t n);
+
+[[nodiscard]] ColorU32 blend_packed(const BlendState& state, ColorU32 src, ColorU32 dst);
+
+}
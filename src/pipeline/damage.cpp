@@ -0,0 +1,118 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "damage.hpp"
+
+#include <algorithm>
+
+namespace cu {
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    auto p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        seed ^= p[i];
+        seed *= 1099511628211ull;
+    }
+    return seed;
+}
+
+uint64_t hash_camera(const Camera& camera, uint64_t seed) {
+    seed = hash_bytes(&camera.frustum, sizeof(camera.frustum), seed);
+    seed = hash_bytes(&camera.position, sizeof(camera.position), seed);
+    seed = hash_bytes(&camera.forward, sizeof(camera.forward), seed);
+    return hash_bytes(&camera.up, sizeof(camera.up), seed);
+}
+
+uint64_t hash_uniform(const Uniform& uniform, uint64_t seed) {
+    // unordered_map has no stable order, so entries are combined commutatively
+    uint64_t h = 0;
+    for (auto&& [name, m] : uniform.matrix)
+        h += hash_bytes(&m, sizeof(m), hash_bytes(name.data(), name.size()));
+    for (auto&& [name, t] : uniform.textures)
+        h += hash_bytes(&t, sizeof(t), hash_bytes(name.data(), name.size()));
+    return hash_bytes(&h, sizeof(h), seed);
+}
+
+DamageTracker::DamageTracker(Extent size, int tile_size)
+: size(size), tile(tile_size), tiles((size + tile_size - 1) / tile_size) {
+    dirty.resize(tiles.x * tiles.y);
+}
+
+void DamageTracker::invalidate() {
+    full = true;
+}
+
+std::span<const Rect> DamageTracker::damage() const {
+    return rects;
+}
+
+void DamageTracker::mark(const Rect& rect) {
+    auto r = rect.intersect({0, 0, size.x, size.y});
+    if (r.empty()) return;
+    for (int y = r.y / tile; y <= (r.y + r.h - 1) / tile; y++)
+        std::fill_n(dirty.begin() + y * tiles.x + r.x / tile, (r.x + r.w - 1) / tile - r.x / tile + 1, 1);
+}
+
+void DamageTracker::collect() {
+    rects.clear();
+    for (int y = 0; y < tiles.y; y++) {
+        for (int x = 0; x < tiles.x;) {
+            if (!dirty[y * tiles.x + x]) {
+                ++x;
+                continue;
+            }
+            int b = x;
+            while (x < tiles.x && dirty[y * tiles.x + x]) ++x;
+
+            Rect r = Rect{b * tile, y * tile, (x - b) * tile, tile}.intersect({0, 0, size.x, size.y});
+            // merge with the run right above if it spans the same columns
+            auto above = std::find_if(rects.begin(), rects.end(), [&](auto&& i) {
+                return i.x == r.x && i.w == r.w && i.y + i.h == r.y;
+            });
+            if (above != rects.end()) above->h += r.h;
+            else rects.push_back(r);
+        }
+    }
+    std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+std::span<const Rect> DamageTracker::render(Pipeline& pipe, std::span<const DrawItem> draws, const Color& clear_color) {
+    if (full) mark({0, 0, size.x, size.y});
+
+    for (auto&& [id, st] : states) st.seen = false;
+    for (auto&& item : draws) {
+        auto [it, inserted] = states.try_emplace(item.id);
+        auto& st = it->second;
+        if (inserted || full || st.hash != item.hash) {
+            if (!inserted) mark(st.bounds); // where it was
+            st.bounds = pipe.measure([&] { item.draw(pipe); });
+            st.hash = item.hash;
+            mark(st.bounds); // where it is now
+        }
+        st.seen = true;
+    }
+    std::erase_if(states, [&](auto&& i) {
+        if (!i.second.seen) mark(i.second.bounds); // removed draws leave a hole
+        return !i.second.seen;
+    });
+    full = false;
+
+    collect();
+
+    auto scissor = pipe.get_scissor();
+    for (auto&& r : rects) {
+        pipe.clear_color(clear_color, r);
+        pipe.clear_depth(r);
+        pipe.set_scissor(scissor ? r.intersect(*scissor) : r);
+        for (auto&& item : draws)
+            if (!states[item.id].bounds.intersect(r).empty())
+                item.draw(pipe);
+        pipe.finish();
+    }
+    pipe.set_scissor(scissor);
+
+    return rects;
+}
+
+}
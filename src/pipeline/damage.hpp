@@ -0,0 +1,64 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "pipeline.hpp"
+
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+namespace cu {
+
+// FNV-1a, used to fingerprint the inputs of a draw
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+uint64_t hash_camera(const Camera& camera, uint64_t seed = 14695981039346656037ull);
+// textures are hashed by identity, changes to their contents are not seen
+uint64_t hash_uniform(const Uniform& uniform, uint64_t seed = 14695981039346656037ull);
+
+template <class T>
+uint64_t hash_span(std::span<const T> data, uint64_t seed = 14695981039346656037ull) {
+    return hash_bytes(data.data(), data.size_bytes(), seed);
+}
+
+struct DrawItem {
+    uint64_t id;   // stable across frames
+    uint64_t hash; // must change whenever anything the draw depends on changes
+    std::function<void(Pipeline&)> draw;
+};
+
+// re-renders only the tiles touched by changed draws
+class DamageTracker {
+public:
+    explicit DamageTracker(Extent size, int tile_size = 16);
+
+    // clears and redraws the damaged tiles, draws are executed in order clipped by the scissor
+    // returns the damaged region, which is empty for a static frame
+    std::span<const Rect> render(Pipeline& pipe, std::span<const DrawItem> draws, const Color& clear_color);
+
+    void invalidate(); // the next frame is fully redrawn
+    [[nodiscard]] std::span<const Rect> damage() const;
+
+private:
+    struct DrawState {
+        Rect bounds;
+        uint64_t hash;
+        bool seen;
+    };
+
+    void mark(const Rect& rect);
+    void collect();
+
+    Extent size;
+    int tile;
+    Extent tiles;
+    bool full = true;
+
+    std::unordered_map<uint64_t, DrawState> states;
+    std::vector<uint8_t> dirty;
+    std::vector<Rect> rects;
+};
+
+}
@@ -0,0 +1,140 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "depth.hpp"
+
+#include <bit>
+#include <limits>
+#include <cstring>
+
+namespace cu {
+
+float depth_clear_value(DepthConvention convention) {
+    return convention == DepthConvention::reversed_z ? 0.f : std::numeric_limits<float>::infinity();
+}
+
+CompareOp default_depth_compare(DepthConvention convention) {
+    return convention == DepthConvention::reversed_z ? CompareOp::greater : CompareOp::less;
+}
+
+CompareOp mirror_compare(CompareOp op) {
+    switch (op) {
+        case CompareOp::less:    return CompareOp::greater;
+        case CompareOp::lequal:  return CompareOp::gequal;
+        case CompareOp::greater: return CompareOp::less;
+        case CompareOp::gequal:  return CompareOp::lequal;
+        default:                 return op; // symmetric
+    }
+}
+
+namespace {
+
+template <CompareOp Op>
+constexpr bool compare(float a, float b) {
+    if constexpr (Op == CompareOp::never) return false;
+    if constexpr (Op == CompareOp::less) return a < b;
+    if constexpr (Op == CompareOp::equal) return a == b;
+    if constexpr (Op == CompareOp::lequal) return a <= b;
+    if constexpr (Op == CompareOp::greater) return a > b;
+    if constexpr (Op == CompareOp::notequal) return a != b;
+    if constexpr (Op == CompareOp::gequal) return a >= b;
+    if constexpr (Op == CompareOp::always) return true;
+}
+
+#ifdef CU_ENABLED_SIMD
+
+// 4-bit movemask -> 4 mask bytes
+constexpr auto expand4 = [] {
+    std::array<uint32_t, 16> r{};
+    for (uint32_t i = 0; i < 16; i++)
+        for (uint32_t b = 0; b < 4; b++)
+            if (i >> b & 1) r[i] |= 1u << (b * 8);
+    return r;
+}();
+
+template <CompareOp Op>
+int mm_compare4(const float* a, const float* b) {
+    auto x = _mm_loadu_ps(a), y = _mm_loadu_ps(b);
+    if constexpr (Op == CompareOp::never) return 0;
+    if constexpr (Op == CompareOp::less) return _mm_movemask_ps(_mm_cmplt_ps(x, y));
+    if constexpr (Op == CompareOp::equal) return _mm_movemask_ps(_mm_cmpeq_ps(x, y));
+    if constexpr (Op == CompareOp::lequal) return _mm_movemask_ps(_mm_cmple_ps(x, y));
+    if constexpr (Op == CompareOp::greater) return _mm_movemask_ps(_mm_cmpgt_ps(x, y));
+    if constexpr (Op == CompareOp::notequal) return _mm_movemask_ps(_mm_cmpneq_ps(x, y));
+    if constexpr (Op == CompareOp::gequal) return _mm_movemask_ps(_mm_cmpge_ps(x, y));
+    if constexpr (Op == CompareOp::always) return 0xF;
+}
+
+#ifdef __AVX__
+template <CompareOp Op>
+int mm_compare8(const float* a, const float* b) {
+    constexpr int pred = Op == CompareOp::less     ? _CMP_LT_OQ :
+                         Op == CompareOp::equal    ? _CMP_EQ_OQ :
+                         Op == CompareOp::lequal   ? _CMP_LE_OQ :
+                         Op == CompareOp::greater  ? _CMP_GT_OQ :
+                         Op == CompareOp::notequal ? _CMP_NEQ_UQ :
+                         Op == CompareOp::gequal   ? _CMP_GE_OQ :
+                         Op == CompareOp::always   ? _CMP_TRUE_UQ : _CMP_FALSE_OQ;
+    return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b), pred));
+}
+#endif
+
+#endif
+
+template <CompareOp Op>
+size_t compare_span(const float* src, const float* dst, uint8_t* mask, size_t n) {
+    size_t i = 0, passed = 0;
+#ifdef CU_ENABLED_SIMD
+#ifdef __AVX__
+    for (; i + 8 <= n; i += 8) {
+        auto bits = mm_compare8<Op>(src + i, dst + i);
+        uint32_t m[2] = {expand4[bits & 0xF], expand4[bits >> 4]};
+        std::memcpy(mask + i, m, 8);
+        passed += std::popcount((unsigned)bits);
+    }
+#endif
+    for (; i + 4 <= n; i += 4) {
+        auto bits = mm_compare4<Op>(src + i, dst + i);
+        std::memcpy(mask + i, &expand4[bits], 4);
+        passed += std::popcount((unsigned)bits);
+    }
+#endif
+    for (; i < n; i++) {
+        mask[i] = compare<Op>(src[i], dst[i]);
+        passed += mask[i];
+    }
+    return passed;
+}
+
+}
+
+bool compare_depth(CompareOp op, float src, float dst) {
+    switch (op) {
+        case CompareOp::never:    return false;
+        case CompareOp::less:     return src < dst;
+        case CompareOp::equal:    return src == dst;
+        case CompareOp::lequal:   return src <= dst;
+        case CompareOp::greater:  return src > dst;
+        case CompareOp::notequal: return src != dst;
+        case CompareOp::gequal:   return src >= dst;
+        case CompareOp::always:   return true;
+        default: return false;
+    }
+}
+
+size_t compare_depth_span(CompareOp op, const float* src, const float* dst, uint8_t* mask, size_t n) {
+    switch (op) {
+        case CompareOp::never:    return compare_span<CompareOp::never>(src, dst, mask, n);
+        case CompareOp::less:     return compare_span<CompareOp::less>(src, dst, mask, n);
+        case CompareOp::equal:    return compare_span<CompareOp::equal>(src, dst, mask, n);
+        case CompareOp::lequal:   return compare_span<CompareOp::lequal>(src, dst, mask, n);
+        case CompareOp::greater:  return compare_span<CompareOp::greater>(src, dst, mask, n);
+        case CompareOp::notequal: return compare_span<CompareOp::notequal>(src, dst, mask, n);
+        case CompareOp::gequal:   return compare_span<CompareOp::gequal>(src, dst, mask, n);
+        case CompareOp::always:   return compare_span<CompareOp::always>(src, dst, mask, n);
+        default: return 0;
+    }
+}
+
+}
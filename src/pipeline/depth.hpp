@@ -0,0 +1,45 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "core.hpp"
+
+namespace cu {
+
+// passes when `incoming op stored`
+enum class CompareOp {
+    never,
+    less,
+    equal,
+    lequal,
+    greater,
+    notequal,
+    gequal,
+    always
+};
+
+enum class DepthConvention {
+    standard,  // view distance, closer is smaller, clear to +inf and compare with less
+    reversed_z // near / distance in (0, 1], closer is bigger, clear to 0 and compare with greater
+};
+
+// converts the interpolated 1/z (view space) into the stored depth value
+[[nodiscard]] inline float depth_from_rhw(float rz, DepthConvention convention, float near) {
+    // reversed-Z with the infinite far plane of Frustum::mat needs no division at all
+    return convention == DepthConvention::reversed_z ? -near * rz : -1.f / rz;
+}
+
+[[nodiscard]] float depth_clear_value(DepthConvention convention);
+// less for standard depth and greater for reversed-Z
+[[nodiscard]] CompareOp default_depth_compare(DepthConvention convention);
+// the op with its direction swapped, for moving a test between the two conventions
+[[nodiscard]] CompareOp mirror_compare(CompareOp op);
+
+[[nodiscard]] bool compare_depth(CompareOp op, float src, float dst);
+
+// mask[i] is set to 1 where src[i] passes against dst[i] and 0 elsewhere, returns the number of passed
+size_t compare_depth_span(CompareOp op, const float* src, const float* dst, uint8_t* mask, size_t n);
+
+}
@@ -7,6 +7,9 @@
 
 #include "pipeline.hpp"
 
+#include <vector>
+#include <cstring>
+#include <limits>
 #include <algorithm>
 #include <utility>
 
@@ -18,30 +21,47 @@ Pipeline::Pipeline(const PipelineInitInfo& info) :
     camera(info.camera),
     vertexShader(info.vertexShader),
     fragmentShader(info.fragmentShader),
+    packedFragmentShader(info.packedFragmentShader),
+    instanceVertexShader(info.instanceVertexShader),
     uniform(info.uniform),
     frame(info.frame),
     viewport(info.viewport),
+    scissor(info.scissor),
     cullFace(info.cullFace),
+    instanceCulling(info.instance_culling),
+    shadingRate(info.shading_rate),
+    shadingRateImage(info.shading_rate_image),
     enableDepthTest(info.enable_depth_test),
     enableDepthWrite(info.enable_depth_write),
+    depthCompare(info.depth_compare.value_or(default_depth_compare(info.depth_convention))),
+    depthConvention(info.depth_convention),
     depthFunc(info.depth_func),
     enableBlend(info.enable_blend),
+    blendState(info.blend_state),
     blendFunc(info.blend_func)
 {
+    colorTarget = dynamic_cast<ImageRGBA8*>(frame.color_image.get());
+    depthTarget = dynamic_cast<ImageF32*>(frame.depth_image.get());
     init_rasterizer();
 }
 
 void Pipeline::draw_point(const Vertex& point) {
     auto v = point;
+    transform_vertex(v);
+    assemble_point(v);
+}
+
+void Pipeline::assemble_point(const Vertex& point) {
+    auto v = point;
 
-    auto w = call_vertex_shader(v);
+    auto w = v.attr.var.other[0];
     if (!point_frustum_culling(v, w)) return; // failed
 
     perspective_division(v, w);
     viewport_transform(v);
     v.rhw_init();
 
-    fragment_shader_callback(v); // no need to rasterize
+    rast_draw_point(v); // no need to rasterize
 }
 
 // [Cohen–Sutherland algorithm](https://en.wikipedia.org/wiki/Cohen–Sutherland_algorithm)
@@ -108,8 +128,12 @@ line_clip(const vec2 &b, const vec2 &e, const vec2 &min = {-1.f}, const vec2 &ma
 
 void Pipeline::draw_line(const std::array<Vertex, 2>& vertices) {
     auto v = vertices;
-    for (auto&& i : v) i.attr.var.other[0] = call_vertex_shader(i);
+    for (auto&& i : v) transform_vertex(i);
+    assemble_line(v);
+}
 
+void Pipeline::assemble_line(const std::array<Vertex, 2>& vertices) {
+    auto v = vertices;
     if (!line_frustum_culling(v)) return;
 
     for (auto&& i : v) {
@@ -119,24 +143,31 @@ void Pipeline::draw_line(const std::array<Vertex, 2>& vertices) {
 
     if (auto clipped = line_clip(v[0].pos, v[1].pos)) {
         auto&& [a, b] = *clipped;
-        float dy = v[1].pos.y - v[0].pos.y;
-        float eya = a.y - v[0].pos.y;
-        float eyb = b.y - v[0].pos.y;
-        float ta = eya / dy;
-        float tb = eyb / dy;
-        v[0] = lerp(v[0], v[1], ta);
-        v[1] = lerp(v[0], v[1], tb);
+        // parameterized along the major axis like Rasterizer::draw_line, the minor one may not move at all
+        const bool x_major = std::abs(v[1].pos.x - v[0].pos.x) > std::abs(v[1].pos.y - v[0].pos.y);
+        auto t = [&](const auto& p) {
+            float d = x_major ? v[1].pos.x - v[0].pos.x : v[1].pos.y - v[0].pos.y;
+            float e = x_major ? p.x - v[0].pos.x : p.y - v[0].pos.y;
+            return d == 0 ? 0.f : e / d; // both ends on one point
+        };
+        v = {lerp(v[0], v[1], t(a)), lerp(v[0], v[1], t(b))}; // both from the unclipped ends
     } else return;
 
     for (auto&& i : v) viewport_transform(i);
 
+    if (!clip_rect_culling(v)) return;
+
     rast_draw_line(v);
 }
 
 void Pipeline::draw_triangle(const std::array<Vertex, 3>& vertices) {
     auto v = vertices;
-    for (auto&& i : v) i.attr.var.other[0] = call_vertex_shader(i);
+    for (auto&& i : v) transform_vertex(i);
+    assemble_triangle(v);
+}
 
+void Pipeline::assemble_triangle(const std::array<Vertex, 3>& vertices) {
+    auto v = vertices;
     auto [succ, v2] = triangle_frustum_culling(v);
     if (!succ) return; // failed
 
@@ -146,6 +177,7 @@ void Pipeline::draw_triangle(const std::array<Vertex, 3>& vertices) {
             viewport_transform(i);
         }
 
+        if (!clip_rect_culling(v)) return; // out of the viewport or the scissor
         if (!face_culling(v)) return; // failed
 
         for (auto&& i : v) i.rhw_init();
@@ -156,6 +188,22 @@ void Pipeline::draw_triangle(const std::array<Vertex, 3>& vertices) {
     if (v2) next(*v2);
 }
 
+void Pipeline::submit_point(const Vertex& v) {
+    assemble_point(v);
+}
+
+void Pipeline::submit_line(const std::array<Vertex, 2>& v) {
+    assemble_line(v);
+}
+
+void Pipeline::submit_triangle(const std::array<Vertex, 3>& v) {
+    assemble_triangle(v);
+}
+
+void Pipeline::transform_vertex(Vertex& v) const {
+    v.attr.var.other[0] = call_vertex_shader(v);
+}
+
 void Pipeline::draw_triangle_line(const std::array<Vertex, 3>& v) {
     draw_line({v[0], v[1]});
     draw_line({v[1], v[2]});
@@ -163,34 +211,76 @@ void Pipeline::draw_triangle_line(const std::array<Vertex, 3>& v) {
 }
 
 void Pipeline::draw_indexed_point(const VertexArray& array, std::span<const IndexGroup> indices) {
-    for (auto&& i : array.getVertices(indices))
-        draw_point(i);
+    draw_array(array, indices, Topology::point);
 }
 
 void Pipeline::draw_indexed_line(const VertexArray& array, std::span<const IndexGroup> indices) {
-    for (auto&& i : array.getLines(indices))
-        draw_line(i);
+    draw_array(array, indices, Topology::line);
 }
 
 void Pipeline::draw_indexed_triangle(const VertexArray& array, std::span<const IndexGroup> indices) {
-    for (auto&& i : array.getTriangles(indices))
-        draw_triangle(i);
+    draw_array(array, indices, Topology::triangle);
+}
+
+template <bool Transformed, class R>
+void Pipeline::draw_shared(R&& vertices, Topology topo) {
+    // the transformed fan center or the vertex before last, and the last vertex
+    std::array<Vertex, 2> w;
+    size_t i = 0;
+    for (auto&& src : vertices) {
+        Vertex v = src;
+        if constexpr (!Transformed) transform_vertex(v);
+        switch (topo) {
+            case Topology::triangle_fan:
+                if (i >= 2) submit_triangle({w[0], w[1], v});
+                w[i == 0 ? 0 : 1] = v;
+                break;
+            case Topology::triangle_strip:
+                // every other triangle is flipped to keep the winding
+                if (i >= 2) {
+                    if (i & 1) submit_triangle({w[1], w[0], v});
+                    else submit_triangle({w[0], w[1], v});
+                }
+                w[0] = w[1], w[1] = v;
+                break;
+            case Topology::line_strip:
+                if (i >= 1) submit_line({w[1], v});
+                w[1] = v;
+                break;
+            default:
+                break;
+        }
+        ++i;
+    }
 }
 
 void Pipeline::draw_array(const VertexArray& array, std::span<const IndexGroup> indices, Topology topo) {
-    switch (topo) {
-        case Topology::point:
-            draw_indexed_point(array, indices);
-            break;
-        case Topology::line:
-            draw_indexed_line(array, indices);
-            break;
-        case Topology::triangle:
-            draw_indexed_triangle(array, indices);
-            break;
-        default:
-            draw_array(array.getVertices(indices), topo);
-            break;
+    // runs between restart indices are drawn on their own, a list drops its incomplete primitive
+    for (size_t b = 0, e; b < indices.size(); b = e + 1) {
+        e = b;
+        while (e < indices.size() && indices[e].pos != primitive_restart) ++e;
+        auto run = indices.subspan(b, e - b);
+        switch (topo) {
+            case Topology::point:
+                for (auto&& i : array.vertices(run))
+                    draw_point(i);
+                break;
+            case Topology::line:
+                for (auto&& i : array.lines(run))
+                    draw_line(i);
+                break;
+            case Topology::triangle:
+                for (auto&& i : array.triangles(run))
+                    draw_triangle(i);
+                break;
+            case Topology::triangle_line:
+                for (auto&& i : array.triangles(run))
+                    draw_triangle_line(i);
+                break;
+            default:
+                draw_shared(array.vertices(run), topo);
+                break;
+        }
     }
 }
 
@@ -208,19 +298,245 @@ void Pipeline::draw_array(std::span<const Vertex> array, Topology topo) {
             for (int i = 2; i < array.size(); i += 3)
                 draw_triangle({array[i - 2], array[i - 1], array[i]});
             break;
-        case Topology::triangle_fan:
-            for (int i = 2; i < array.size(); i += 3)
-                draw_triangle({array[0], array[i - 1], array[i]});
-            break;
         case Topology::triangle_line:
             for (int i = 2; i < array.size(); i += 3)
                 draw_triangle_line({array[i - 2], array[i - 1], array[i]});
             break;
+        case Topology::triangle_fan:
+        case Topology::triangle_strip:
+        case Topology::line_strip:
+            draw_shared(array, topo);
+            break;
         default:
             break;
     }
 }
 
+template <class I>
+void Pipeline::assemble_indexed(std::span<const Vertex> t, I&& index, size_t n, Topology topo) {
+    // runs between restart indices are assembled on their own, a list drops its incomplete primitive
+    for (size_t b = 0, e; b < n; b = e + 1) {
+        e = b;
+        while (e < n && index(e) != primitive_restart) ++e;
+        switch (topo) {
+            case Topology::point:
+                for (size_t i = b; i < e; i++)
+                    submit_point(t[index(i)]);
+                break;
+            case Topology::line:
+                for (size_t i = b + 1; i < e; i += 2)
+                    submit_line({t[index(i - 1)], t[index(i)]});
+                break;
+            case Topology::triangle:
+                for (size_t i = b + 2; i < e; i += 3)
+                    submit_triangle({t[index(i - 2)], t[index(i - 1)], t[index(i)]});
+                break;
+            case Topology::triangle_line:
+                for (size_t i = b + 2; i < e; i += 3) {
+                    auto &v0 = t[index(i - 2)], &v1 = t[index(i - 1)], &v2 = t[index(i)];
+                    submit_line({v0, v1});
+                    submit_line({v1, v2});
+                    submit_line({v2, v0});
+                }
+                break;
+            default:
+                draw_shared<true>(std::views::iota(b, e) | std::views::transform([&](size_t i) -> const Vertex& {
+                    return t[index(i)];
+                }), topo);
+                break;
+        }
+    }
+}
+
+namespace {
+
+// post transform vertices of draw_mesh and draw_instanced, it only grows
+thread_local std::vector<Vertex> mesh_buf;
+// fetched vertices shared by the instances
+thread_local std::vector<Vertex> instance_buf;
+// indices into instance_buf of draw_instanced over IndexGroups
+thread_local std::vector<uint32_t> instance_indices;
+
+// world space planes of the frustum, a point p is inside when dot(n, p) + d >= 0 for all of them
+struct FrustumPlanes {
+    std::array<vec4, 5> planes;
+
+    explicit FrustumPlanes(const Camera& cam) {
+        // clip = proj_view * p is affine in p, its rows are read off by transforming the origin and the axes
+        auto m = cam.proj_view();
+        auto o = m * vec4{0.f, 0.f, 0.f, 1.f};
+        vec4 ax[3] = {m * vec4{1.f, 0.f, 0.f, 0.f}, m * vec4{0.f, 1.f, 0.f, 0.f}, m * vec4{0.f, 0.f, 1.f, 0.f}};
+        auto row = [&](int i) { return vec4{ax[0][i], ax[1][i], ax[2][i], o[i]}; };
+        auto x = row(0), y = row(1), z = row(2), w = row(3);
+        // |x|, |y| <= w and z <= -near, see the frustum culling of the primitives
+        planes = {w - x, w + x, w - y, w + y, z * -1.f - vec4{0.f, 0.f, 0.f, cam.frustum.near}};
+        for (auto& p : planes)
+            if (auto len = vec3(p).length(); len > 0.f) p /= len;
+    }
+
+    [[nodiscard]] bool visible(const vec3& center, float radius) const {
+        for (auto& p : planes)
+            if (dot(vec3(p), center) + p.w < -radius) return false;
+        return true;
+    }
+};
+
+}
+
+void Pipeline::draw_mesh(const MeshView& mesh, Topology topo) {
+    auto& t = mesh_buf;
+    t.resize(mesh.vertex_count());
+    for (uint32_t i = 0; i < t.size(); i++) {
+        t[i] = mesh.get(i);
+        transform_vertex(t[i]);
+    }
+    assemble_indexed(t, [&mesh](size_t i) { return mesh.index(i); }, mesh.index_count(), topo);
+}
+
+void Pipeline::draw_instanced(const VertexArray& array, std::span<const IndexGroup> indices, Topology topo,
+                              std::span<const InstanceData> instances) {
+    // restarts get no vertex, so they aren't transformed for every instance
+    auto& src = instance_buf;
+    auto& idx = instance_indices;
+    src.clear();
+    idx.clear();
+    src.reserve(indices.size());
+    idx.reserve(indices.size());
+    for (auto&& i : indices) {
+        if (i.pos == primitive_restart) {
+            idx.push_back(primitive_restart);
+            continue;
+        }
+        idx.push_back((uint32_t)src.size());
+        src.push_back(array.get(i));
+        if (!i.col) src.back().attr.var.color = Color{1.f}; // the tint becomes the color
+    }
+    draw_instances(src, [&idx](size_t i) { return idx[i]; }, idx.size(), topo, instances);
+}
+
+void Pipeline::draw_instanced(const MeshView& mesh, Topology topo, std::span<const InstanceData> instances) {
+    auto& src = instance_buf;
+    src.resize(mesh.vertex_count());
+    for (uint32_t i = 0; i < src.size(); i++) {
+        src[i] = mesh.get(i);
+        if (mesh.colors.empty()) src[i].attr.var.color = Color{1.f}; // the tint becomes the color
+    }
+    draw_instances(src, [&mesh](size_t i) { return mesh.index(i); }, mesh.index_count(), topo, instances);
+}
+
+template <class I>
+void Pipeline::draw_instances(std::span<const Vertex> src, I&& index, size_t n, Topology topo,
+                              std::span<const InstanceData> instances) {
+    // bounding sphere of the referenced vertices in model space
+    vec3 lo{std::numeric_limits<float>::max()}, hi{-std::numeric_limits<float>::max()};
+    for (size_t i = 0; i < n; i++) {
+        auto v = index(i);
+        if (v == primitive_restart) continue;
+        auto& p = src[v].pos;
+        lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+        hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+    }
+    if (lo.x > hi.x) return; // nothing to draw
+    const vec3 center = (lo + hi) * .5f;
+    float radius = 0.f;
+    for (size_t i = 0; i < n; i++)
+        if (auto v = index(i); v != primitive_restart)
+            radius = std::max(radius, (src[v].pos - center).length());
+
+    std::optional<FrustumPlanes> frustum;
+    if (instanceCulling) frustum.emplace(*camera);
+
+    auto& t = mesh_buf;
+    t.resize(src.size());
+    for (auto&& inst : instances) {
+        if (frustum) {
+            auto& m = inst.model;
+            // the longest axis bounds the scale of the radius
+            float scale = std::max({vec3(m * vec4{1.f, 0.f, 0.f, 0.f}).length(),
+                                    vec3(m * vec4{0.f, 1.f, 0.f, 0.f}).length(),
+                                    vec3(m * vec4{0.f, 0.f, 1.f, 0.f}).length()});
+            if (!frustum->visible(vec3(m * vec4{center, 1.f}), radius * scale)) continue;
+        }
+
+        for (size_t i = 0; i < src.size(); i++) {
+            t[i] = src[i];
+            t[i].attr.var.color *= inst.color;
+            transform_instance(t[i], inst);
+        }
+        assemble_indexed(t, index, n, topo);
+    }
+}
+
+void Pipeline::transform_instance(Vertex& v, const InstanceData& instance) const {
+    if (instanceVertexShader) {
+        assert(camera && uniform);
+        const auto v1 = instanceVertexShader(v, instance, *uniform, *camera);
+        v.pos = {v1.x, v1.y, v1.z};
+        v.attr.var.other[0] = v1.w;
+    } else {
+        v.pos = vec3(instance.model * vec4{v.pos, 1.f});
+        transform_vertex(v);
+    }
+}
+
+void Pipeline::draw_with_depth_prepass(const std::function<void()>& draws, bool opaque) {
+    assert(frame.depth_image && "depth prepass needs a depth target");
+
+    passMode = PassMode::depth;
+    prepassOpaque = opaque;
+    draws();
+    finish();
+
+    auto ext = frame.depth_image->size();
+    prepassShaded.assign((size_t)ext.x * ext.y, 0);
+    passMode = PassMode::shade;
+    replay_prepass();
+    finish();
+
+    passMode = PassMode::normal;
+    prepassShaded.clear();
+    prepass.points.clear();
+    prepass.lines.clear();
+    prepass.triangles.clear();
+}
+
+Rect Pipeline::measure(const std::function<void()>& draws) {
+    passMode = PassMode::measure;
+    measured = {};
+    draws();
+    finish();
+    passMode = PassMode::normal;
+    return measured;
+}
+
+void Pipeline::measure_primitive(std::span<const Vertex> v) {
+    float l = v[0].pos.x, r = l, b = v[0].pos.y, t = b;
+    for (auto&& i : v) {
+        l = std::min(l, i.pos.x), r = std::max(r, i.pos.x);
+        b = std::min(b, i.pos.y), t = std::max(t, i.pos.y);
+    }
+    Rect rect = {(int)std::floor(l), (int)std::floor(b), 0, 0};
+    rect.w = (int)std::ceil(r) - rect.x + 1;
+    rect.h = (int)std::ceil(t) - rect.y + 1;
+    rect = rect.intersect(clip_rect());
+
+    std::lock_guard lock{prepassMutex};
+    measured = measured.unite(rect);
+}
+
+void Pipeline::replay_prepass() {
+    for (auto&& i : prepass.points)
+        fragment_shader_callback(i);
+    for (auto&& i : prepass.lines)
+        rast_draw_line(i);
+    for (auto&& i : prepass.triangles)
+        rast_draw_triangle(i);
+}
+
+const Pipeline::PrepassList& Pipeline::prepass_list() const {
+    return prepass;
+}
+
 void Pipeline::set_uniform(std::shared_ptr<Uniform> u) {
     this->uniform = std::move(u);
 }
@@ -237,18 +553,64 @@ void Pipeline::set_fragment_shader(const FragmentShader& fragment_shader) {
     this->fragmentShader = fragment_shader;
 }
 
+void Pipeline::set_packed_fragment_shader(const PackedFragmentShader& fragment_shader) {
+    this->packedFragmentShader = fragment_shader;
+}
+
+void Pipeline::set_instance_vertex_shader(const InstanceVertexShader& vertex_shader) {
+    this->instanceVertexShader = vertex_shader;
+}
+
+void Pipeline::set_viewport(const Viewport& vp) {
+    viewport = vp;
+}
+
+const Viewport& Pipeline::get_viewport() const {
+    return viewport;
+}
+
+void Pipeline::set_scissor(const std::optional<Rect>& rect) {
+    scissor = rect;
+}
+
+const std::optional<Rect>& Pipeline::get_scissor() const {
+    return scissor;
+}
+
 void Pipeline::set_cull_face(CullFace face) {
     cullFace = face;
 }
 
+void Pipeline::set_instance_culling(bool enable) {
+    instanceCulling = enable;
+}
+
+void Pipeline::set_shading_rate(ShadingRate rate) {
+    shadingRate = rate;
+}
+
+void Pipeline::set_shading_rate_image(std::shared_ptr<const ShadingRateImage> image) {
+    shadingRateImage = std::move(image);
+}
+
 void Pipeline::set_depth_test(bool enable) {
-    enableBlend = enable;
+    enableDepthTest = enable;
 }
 
 void Pipeline::set_depth_write(bool enable) {
     enableDepthWrite = enable;
 }
 
+void Pipeline::set_depth_compare(CompareOp op) {
+    depthCompare = op;
+    depthFunc = nullptr;
+}
+
+void Pipeline::set_depth_convention(DepthConvention convention) {
+    if (convention != depthConvention) depthCompare = mirror_compare(depthCompare);
+    depthConvention = convention;
+}
+
 void Pipeline::set_depth_func(const DepthFunc& func) {
     depthFunc = func;
 }
@@ -257,10 +619,30 @@ void Pipeline::set_blend(bool enable) {
     enableBlend = enable;
 }
 
+void Pipeline::set_blend_state(const BlendState& state) {
+    blendState = state;
+    blendFunc = nullptr;
+}
+
 void Pipeline::set_blend_func(const BlendFunc& func) {
     blendFunc = func;
 }
 
+void Pipeline::clear_depth() const {
+    if (frame.depth_image)
+        frame.depth_image->clear(Color{depth_far()});
+}
+
+void Pipeline::clear_depth(const Rect& rect) const {
+    if (frame.depth_image)
+        frame.depth_image->clear_rect(rect, Color{depth_far()});
+}
+
+void Pipeline::clear_color(const Color& color, const Rect& rect) const {
+    if (frame.color_image)
+        frame.color_image->clear_rect(rect, color);
+}
+
 float Pipeline::call_vertex_shader(Vertex& v) const {
     assert(camera && uniform && vertexShader);
     const auto v1 = vertexShader(v, *uniform, *camera);
@@ -383,6 +765,25 @@ void Pipeline::viewport_transform(Vertex& v) const {
     v.pos.y = y;
 }
 
+Rect Pipeline::clip_rect() const {
+    auto r = viewport.rect();
+    return scissor ? r.intersect(*scissor) : r;
+}
+
+bool Pipeline::clip_rect_culling(std::span<const Vertex> v) const {
+    auto clip = clip_rect();
+    if (clip.empty()) return false; // failed
+
+    float l = v[0].pos.x, r = l, b = v[0].pos.y, t = b;
+    for (auto&& i : v) {
+        l = std::min(l, i.pos.x), r = std::max(r, i.pos.x);
+        b = std::min(b, i.pos.y), t = std::max(t, i.pos.y);
+    }
+    // conservative, the rasterizer does the exact clipping
+    return r >= (float)clip.x - 1.f && l <= (float)(clip.x + clip.w) &&
+           t >= (float)clip.y - 1.f && b <= (float)(clip.y + clip.h);
+}
+
 bool Pipeline::face_culling(const std::array<Vertex, 3>& v) const {
     if (cullFace == CullFace::none)
         return true; // passed
@@ -396,38 +797,236 @@ bool Pipeline::face_culling(const std::array<Vertex, 3>& v) const {
 }
 
 void Pipeline::fragment_shader_callback(const Vertex& v) {
-    assert(camera && uniform && fragmentShader);
+    assert(camera && uniform && (fragmentShader || packedFragmentShader));
 
     ivec2 pos = {(int)v.pos.x, (int)v.pos.y};
+    if (!clip_rect().contains(pos)) return; // points and lines aren't clipped by the rasterizer
+
+    if (!depth_test(pos, v.pos.z)) return;
 
-    if (depth_test(pos, v.pos.z))
-        call_fragment_shader(pos, v);
+    // late write as in fragment_span_callback, a discarded fragment leaves the depth alone
+    // the depth pass only asks the shader about discards, the shade pass takes the pixel with the write
+    bool kept = passMode == PassMode::depth ? prepassOpaque || shade_packed(v) : call_fragment_shader(pos, v);
+    if (kept && depth_test_enabled() && (depth_write_enabled() || passMode == PassMode::shade))
+        store_depth(pos, to_depth(v.pos.z));
 }
 
 bool Pipeline::depth_test(ivec2 pos, float z) {
     if (!depth_test_enabled())
         return true; // haven't been enabled
+    return check_depth(pos, to_depth(z));
+}
 
-    float depth = 1.f / z;
-    if (check_depth(pos, depth))
-        return false; // failed
+namespace {
+
+// per thread scratch of the span walker, it only grows
+struct SpanBuffer {
+    std::vector<float> depth;
+    std::vector<uint8_t> mask;
+    std::vector<ColorU32> color;
+    std::vector<Color> shaded; // float shader output before packing
+
+    void reserve(int n) {
+        if (depth.size() >= (size_t)n) return;
+        depth.resize(n);
+        mask.resize(n);
+        color.resize(n);
+        shaded.resize(n);
+    }
+};
+
+thread_local SpanBuffer span_buf;
+
+// coarse shading results of the triangle being rasterized, indexed by the left pixel of a block
+// a triangle is rasterized on one thread from start to end, so the cache is per thread
+struct CoarseCache {
+    struct Entry {
+        uint64_t serial = 0;
+        int y0 = 0, rate = 0;
+        ColorU32 color{};
+        bool kept = false;
+    };
+
+    uint64_t serial = 0; // of the current triangle
+    std::vector<Entry> entries;
+};
+
+thread_local CoarseCache coarse_cache;
 
-    if (depth_write_enabled())
-        write_depth(pos, depth);
-    return true; // passed
 }
 
-void Pipeline::call_fragment_shader(ivec2 pos, const Vertex& v) {
-    // nullopt if the fragment was discarded
-    auto color = fragmentShader(v, *uniform, *camera);
+ShadingRate ShadingRateImage::get(ivec2 pos) const {
+    int x = std::clamp(pos.x / tile, 0, size.x - 1);
+    int y = std::clamp(pos.y / tile, 0, size.y - 1);
+    return rates[x + y * size.x];
+}
+
+void Pipeline::fragment_span_callback(const Vertex& first, const Vertex& step, int n) {
+    assert(camera && uniform && (fragmentShader || packedFragmentShader));
+
+    const ivec2 pos = {(int)first.pos.x, (int)first.pos.y};
+
+    // custom depth and blend funcs only have per fragment versions
+    if ((depth_test_enabled() && !early_depth_enabled()) || (enableBlend && blendFunc)) {
+        for (int i = 0; i < n; i++)
+            fragment_shader_callback(first + step * (float)i); // interpolated as below
+        return;
+    }
+
+    auto& buf = span_buf;
+    buf.reserve(n);
+    auto mask = buf.mask.data();
+
+    // early depth test, only 1/z is interpolated here
+    if (depth_test_enabled()) {
+        for (int i = 0; i < n; i++)
+            buf.depth[i] = to_depth(first.pos.z + step.pos.z * (float)i);
+        if (depth_test_span(pos, buf.depth.data(), mask, n) == 0)
+            return; // the whole span is occluded
+
+        if (passMode == PassMode::depth) {
+            // the shader only decides about discards here, a discarded fragment mustn't hide what is behind it
+            const bool coarse = colorTarget && coarse_shading_enabled();
+            for (int i = 0; i < n; i++) {
+                if (!mask[i]) continue;
+                auto v = first + step * (float)i;
+                ivec2 p{pos.x + i, pos.y};
+                if (prepassOpaque || (coarse ? shade_coarse(p, v) : shade_packed(v))) store_depth(p, buf.depth[i]);
+            }
+            return;
+        }
+    } else {
+        std::memset(mask, 1, n);
+    }
+
+    // attributes are only set up for passed fragments, each one straight from the span start,
+    // so they don't depend on the mask and the prepass shades exactly what a normal draw would
+    const bool coarse = colorTarget && coarse_shading_enabled();
+    // float shader output is packed for the whole span at once
+    const bool batch = colorTarget && !coarse && !packedFragmentShader;
+    for (int i = 0; i < n; i++) {
+        if (!mask[i]) continue;
+        auto v = first + step * (float)i;
+        if (batch) {
+            auto color = fragmentShader(v, *uniform, *camera);
+            if (color) buf.shaded[i] = *color;
+            mask[i] = color.has_value();
+        } else if (colorTarget) {
+            auto color = coarse ? shade_coarse({pos.x + i, pos.y}, v) : shade_packed(v);
+            if (color) buf.color[i] = *color;
+            mask[i] = color.has_value();
+        } else { // other targets are written per fragment from floats
+            mask[i] = call_fragment_shader({pos.x + i, pos.y}, v);
+        }
+        // late write, so the early test stays valid for shaders which discard,
+        // in the shade pass it takes the pixel
+        if (mask[i] && depth_test_enabled() && (depth_write_enabled() || passMode == PassMode::shade))
+            store_depth({pos.x + i, pos.y}, buf.depth[i]);
+    }
+
+    if (batch) // discarded entries are packed as well, the mask drops them
+        pack_colors(std::span{buf.shaded.data(), (size_t)n}, buf.color.data());
+    if (colorTarget)
+        write_color_span(pos, buf.color.data(), mask, n);
+}
 
-    // write color
-    if (color) {
-        // blend
-        if (enableBlend && blendFunc)
-            blend_color(pos, *color);
+bool Pipeline::call_fragment_shader(ivec2 pos, const Vertex& v) {
+    if (enableBlend && blendFunc) { // custom blending works on floats
+        std::optional<Color> color;
+        if (packedFragmentShader) {
+            if (auto c = packedFragmentShader(v, *uniform, *camera))
+                color = unpack_color(*c);
+        } else {
+            color = fragmentShader(v, *uniform, *camera);
+        }
+        if (!color) return false; // discarded
 
+        blend_color(pos, *color);
         set_color(pos, *color);
+        return true;
+    }
+
+    if (!packedFragmentShader && !enableBlend) {
+        // nullopt if the fragment was discarded
+        auto color = fragmentShader(v, *uniform, *camera);
+        if (color) set_color(pos, *color);
+        return color.has_value();
+    }
+
+    auto packed = shade_packed(v);
+    if (!packed) return false; // discarded
+
+    if (enableBlend)
+        blend_packed_color(pos, *packed);
+    set_packed_color(pos, *packed);
+    return true;
+}
+
+std::optional<ColorU32> Pipeline::shade_packed(const Vertex& v) const {
+    if (packedFragmentShader)
+        return packedFragmentShader(v, *uniform, *camera);
+    if (auto color = fragmentShader(v, *uniform, *camera))
+        return pack_color(*color);
+    return std::nullopt;
+}
+
+std::optional<ColorU32> Pipeline::shade_coarse(ivec2 pos, const Vertex& v) const {
+    int rate = shading_rate_at(pos);
+    if (rate == 1) return shade_packed(v);
+
+    // the first covered fragment of a block shades it
+    auto& cache = coarse_cache;
+    int x0 = pos.x / rate * rate, y0 = pos.y / rate * rate;
+    if (cache.entries.size() <= (size_t)x0) cache.entries.resize(std::max<size_t>(x0 + 1, colorTarget->size_.x));
+    auto& e = cache.entries[x0];
+    if (e.serial == cache.serial && e.y0 == y0 && e.rate == rate)
+        return e.kept ? std::optional{e.color} : std::nullopt;
+
+    auto color = shade_packed(v);
+    e = {cache.serial, y0, rate, color.value_or(ColorU32{}), color.has_value()};
+    return color;
+}
+
+bool Pipeline::coarse_shading_enabled() const {
+    return shadingRate != ShadingRate::x1 || shadingRateImage;
+}
+
+int Pipeline::shading_rate_at(ivec2 pos) const {
+    auto rate = shadingRate;
+    if (shadingRateImage) rate = std::max(rate, shadingRateImage->get(pos));
+    return (int)rate;
+}
+
+size_t Pipeline::depth_test_span(ivec2 pos, const float* depth, uint8_t* mask, int n) {
+    if (passMode != PassMode::shade)
+        return compare_depth_span(depthCompare, depth, depthTarget->row(pos.y) + pos.x, mask, n);
+
+    auto passed = compare_depth_span(CompareOp::equal, depth, depthTarget->row(pos.y) + pos.x, mask, n);
+    auto shaded = prepassShaded.data() + (size_t)pos.y * depthTarget->size().x + pos.x;
+    for (int i = 0; i < n; i++) {
+        if (mask[i] && shaded[i]) mask[i] = 0, --passed;
+    }
+    return passed;
+}
+
+void Pipeline::store_depth(ivec2 pos, float z) {
+    write_depth(pos, z);
+}
+
+void Pipeline::write_color_span(ivec2 pos, const ColorU32* colors, const uint8_t* mask, int n) {
+    auto row = colorTarget->row(pos.y) + pos.x;
+    for (int i = 0; i < n;) {
+        if (!mask[i]) {
+            ++i;
+            continue;
+        }
+        int b = i;
+        while (i < n && mask[i]) ++i;
+
+        if (enableBlend)
+            blend_span(blendState, colors + b, row + b, i - b);
+        else
+            std::memcpy(row + b, colors + b, (i - b) * sizeof(ColorU32));
     }
 }
 
@@ -435,37 +1034,100 @@ void Pipeline::blend_color(ivec2 pos, Color& color) {
     color = blendFunc(frame.color_image->get(pos), color);
 }
 
+void Pipeline::blend_packed_color(ivec2 pos, ColorU32& color) {
+    color = blend_packed(blendState, color, frame.color_image->get_packed(pos));
+}
+
 void Pipeline::set_color(ivec2 pos, const Color& color) {
     frame.color_image->set(pos, color);
 }
 
+void Pipeline::set_packed_color(ivec2 pos, ColorU32 color) {
+    frame.color_image->set_packed(pos, color);
+}
+
 bool Pipeline::depth_test_enabled() const {
-    return enableDepthTest && frame.depth_image;
+    return (enableDepthTest || passMode != PassMode::normal) && frame.depth_image;
 }
 
 bool Pipeline::depth_write_enabled() const {
-    return enableDepthWrite;
+    switch (passMode) {
+        case PassMode::depth: return true;
+        case PassMode::shade: return false;
+        default: return enableDepthWrite;
+    }
 }
 
+bool Pipeline::blend_enabled() const {
+    return enableBlend;
+}
+
+bool Pipeline::early_depth_enabled() const {
+    // fragment shaders can't write depth, so testing before shading is always safe
+    return depthTarget && !depthFunc;
+}
+
+
+float Pipeline::depth_far() const {
+    // custom funcs work on view z, where the far value is -inf
+    return depthFunc ? -std::numeric_limits<float>::infinity() : depth_clear_value(depthConvention);
+}
+
+float Pipeline::to_depth(float rz) const {
+    if (depthFunc) return 1.f / rz; // custom funcs work on view z
+    return depth_from_rhw(rz, depthConvention, camera->frustum.near);
+}
 
 bool Pipeline::check_depth(ivec2 pos, float z) const {
-    return depthFunc(z, frame.depth_image->get(pos).z);
+    auto stored = frame.depth_image->get(pos).r;
+    if (passMode == PassMode::shade)
+        return z == stored && !prepassShaded[(size_t)pos.y * frame.depth_image->size().x + pos.x];
+    if (depthFunc) return !depthFunc(z, stored);
+    return compare_depth(depthCompare, z, stored);
 }
 
-void Pipeline::write_depth(ivec2 pos, float z) const {
+void Pipeline::write_depth(ivec2 pos, float z) {
+    if (passMode == PassMode::shade) { // the depth is already there, the pixel is only marked
+        prepassShaded[(size_t)pos.y * frame.depth_image->size().x + pos.x] = 1;
+        return;
+    }
     frame.depth_image->set(pos, z);
 }
 
+void Pipeline::rast_draw_point(const Vertex& v) {
+    if (passMode == PassMode::measure)
+        return measure_primitive({&v, 1});
+    if (passMode == PassMode::depth) {
+        std::lock_guard lock{prepassMutex};
+        prepass.points.push_back(v);
+    }
+    fragment_shader_callback(v);
+}
+
 void Pipeline::rast_draw_line(const std::array<Vertex, 2>& v) {
+    if (passMode == PassMode::measure)
+        return measure_primitive(v);
+    if (passMode == PassMode::depth) {
+        std::lock_guard lock{prepassMutex};
+        prepass.lines.push_back(v);
+    }
     rasterizer.draw_line(v);
 }
 
 void Pipeline::rast_draw_triangle(const std::array<Vertex, 3>& v) {
-    rasterizer.draw_triangle(v, viewport);
+    if (passMode == PassMode::measure)
+        return measure_primitive(v);
+    if (passMode == PassMode::depth) {
+        std::lock_guard lock{prepassMutex};
+        prepass.triangles.push_back(v);
+    }
+    ++coarse_cache.serial;
+    rasterizer.draw_triangle(v, clip_rect());
 }
 
 void Pipeline::init_rasterizer() {
     rasterizer.callback = [this](auto&&v){fragment_shader_callback(v);};
+    rasterizer.span_callback = [this](auto&&v, auto&&s, int n){fragment_span_callback(v, s, n);};
 }
 
 }
@@ -8,11 +8,15 @@
 #pragma once
 
 #include "core.hpp"
+#include "mesh.hpp"
+#include "blend.hpp"
+#include "depth.hpp"
 #include "rasterize.hpp"
 
 #include <span>
 #include <array>
 #include <memory>
+#include <mutex>
 #include <bitset>
 #include <unordered_map>
 
@@ -26,33 +30,78 @@ struct Uniform {
 // shader functions
 using VertexShader = std::function<vec4(const Vertex&, const Uniform&, const Camera&)>;
 using FragmentShader = std::function<std::optional<Color>(const Vertex&, const Uniform&, const Camera&)>;
+// returns RGBA8 directly, skipping the float -> byte conversion on write
+using PackedFragmentShader = std::function<std::optional<ColorU32>(const Vertex&, const Uniform&, const Camera&)>;
 
+// per instance data of draw_instanced
+struct InstanceData {
+    mat4 model{};
+    Color color{1.f}; // tint, multiplies the color attribute, geometry without colors is drawn in it
+};
+
+// vertex shader of draw_instanced, the instance replaces the uniform model matrix
+using InstanceVertexShader = std::function<vec4(const Vertex&, const InstanceData&, const Uniform&, const Camera&)>;
+
+// custom depth test, slow path taking precedence over CompareOp
+// receives the view z of the fragment and the stored one, returns true if the fragment fails
 using DepthFunc = std::function<bool(float, float)>;
 
+// custom blending, slow path taking precedence over BlendState
 using BlendFunc = std::function<Color(const Color&, const Color&)>;
 constexpr auto default_blend_func = [](const Color& src, const Color& dst) -> Color {
     return lerp(src, dst, dst.a);
 };
 
+// edge of the pixel blocks sharing one fragment shader invocation
+// depth and coverage stay per pixel, only the color is broadcast
+enum class ShadingRate : uint8_t {
+    x1 = 1,
+    x2 = 2,
+    x4 = 4
+};
+
+// screen space shading rates, one per tile of tile x tile pixels
+struct ShadingRateImage {
+    Extent size;   // in tiles
+    int tile = 16; // a multiple of 4, so blocks never straddle tiles
+    std::vector<ShadingRate> rates;
+
+    [[nodiscard]] ShadingRate get(ivec2 pos) const; // pos in pixels, clamped to the image
+};
+
 struct PipelineInitInfo {
     std::shared_ptr<Camera> camera          = nullptr;
 
     VertexShader vertexShader               = nullptr;
     FragmentShader fragmentShader           = nullptr;
+    PackedFragmentShader packedFragmentShader = nullptr; // takes precedence over fragmentShader
+    // without it draw_instanced moves the positions by the instance model and runs vertexShader
+    InstanceVertexShader instanceVertexShader = nullptr;
 
     std::shared_ptr<Uniform> uniform        = nullptr;
 
     FrameBuffer frame;
     Viewport viewport;
+    std::optional<Rect> scissor = std::nullopt; // fragments outside are never generated
 
     CullFace cullFace = CullFace::none;
+    // instance bounds against the frustum, only valid when the vertex stage computes
+    // camera.proj_view() * instance.model * pos, a uniform model matrix on top would move the geometry away from them
+    bool instance_culling = false;
+
+    // the coarser of the two wins; applies to triangles drawn through the span path into RGBA8 targets
+    ShadingRate shading_rate = ShadingRate::x1;
+    std::shared_ptr<const ShadingRateImage> shading_rate_image = nullptr;
 
     bool enable_depth_test = false;
     bool enable_depth_write = false;
-    DepthFunc depth_func = std::less{};
+    std::optional<CompareOp> depth_compare = std::nullopt; // follows the convention when unset
+    DepthConvention depth_convention = DepthConvention::standard;
+    DepthFunc depth_func = nullptr;
 
     bool enable_blend = false;
-    BlendFunc blend_func = default_blend_func;
+    BlendState blend_state{};
+    BlendFunc blend_func = nullptr;
 };
 
 class Pipeline {
@@ -71,35 +120,121 @@ public:
     void draw_indexed_point(const VertexArray& array, std::span<const IndexGroup> indices);
     void draw_indexed_line(const VertexArray& array, std::span<const IndexGroup> indices);
     void draw_indexed_triangle(const VertexArray& array, std::span<const IndexGroup> indices);
+    // split into runs at indices whose pos is primitive_restart, lists drop the incomplete primitive before one
     void draw_array(const VertexArray& array, std::span<const IndexGroup> indices, Topology topo);
     void draw_array(std::span<const Vertex> array, Topology topo);
+    // every vertex of the mesh runs the vertex shader once, however many primitives share it
+    void draw_mesh(const MeshView& mesh, Topology topo);
+
+    // draws the geometry once per instance, the vertices are fetched once for all of them
+    // with instance culling, instances whose bounding sphere is outside the frustum are skipped
+    void draw_instanced(const VertexArray& array, std::span<const IndexGroup> indices, Topology topo,
+                        std::span<const InstanceData> instances);
+    void draw_instanced(const MeshView& mesh, Topology topo, std::span<const InstanceData> instances);
+
+    // runs `draws` twice: first vertex processing and depth writes only, then the recorded
+    // primitives are shaded with an equal depth test, so every pixel is shaded once in the second pass.
+    // the first pass runs the fragment shader as well to honor its discards, unless `opaque` promises
+    // that it never discards, which is where the prepass saves shader calls
+    void draw_with_depth_prepass(const std::function<void()>& draws, bool opaque = false);
+
+    // runs only the vertex stage of `draws` and returns the screen area they would cover
+    [[nodiscard]] Rect measure(const std::function<void()>& draws);
+
+    // waits for all submitted draws
+    virtual void finish() const {}
 
     void set_vertex_shader(const VertexShader& vertex_shader);
     void set_fragment_shader(const FragmentShader& fragment_shader);
+    void set_packed_fragment_shader(const PackedFragmentShader& fragment_shader);
+    void set_instance_vertex_shader(const InstanceVertexShader& vertex_shader);
     void set_camera(std::shared_ptr<Camera> camera);
     void set_uniform(std::shared_ptr<Uniform> uniform);
+    // the frame buffer must cover the new area, call between frames
+    void set_viewport(const Viewport& viewport);
+    [[nodiscard]] const Viewport& get_viewport() const;
+    void set_scissor(const std::optional<Rect>& scissor);
+    [[nodiscard]] const std::optional<Rect>& get_scissor() const;
     void set_cull_face(CullFace face);
+    void set_instance_culling(bool enable);
+    void set_shading_rate(ShadingRate rate);
+    void set_shading_rate_image(std::shared_ptr<const ShadingRateImage> image);
     void set_depth_test(bool enable);
     void set_depth_write(bool enable);
+    void set_depth_compare(CompareOp op); // also drops the custom depth func
+    // a directional compare op is mirrored along, so the test keeps meaning closer or farther
+    void set_depth_convention(DepthConvention convention);
     void set_depth_func(const DepthFunc& func);
     void set_blend(bool enable);
+    void set_blend_state(const BlendState& state); // also drops the custom blend func
     void set_blend_func(const BlendFunc& func);
 
+    // clears the depth target with the far value of the current convention (or -inf for custom funcs)
+    void clear_depth() const;
+    void clear_depth(const Rect& rect) const;
+    void clear_color(const Color& color, const Rect& rect) const;
+
 protected:
+    // vertex stage, the clip w is kept in attr.var.other[0]
+    void transform_vertex(Vertex& v) const;
+    // clipping, culling and rasterization of transformed vertices
+    void assemble_point(const Vertex& vertex);
+    void assemble_line(const std::array<Vertex, 2>& vertices);
+    void assemble_triangle(const std::array<Vertex, 3>& vertices);
+    // entry of primitives whose vertices are shared and already transformed, assembles them by default
+    virtual void submit_point(const Vertex& vertex);
+    virtual void submit_line(const std::array<Vertex, 2>& vertices);
+    virtual void submit_triangle(const std::array<Vertex, 3>& vertices);
+
     void fragment_shader_callback(const Vertex&);
+    void fragment_span_callback(const Vertex& first, const Vertex& step, int n);
 
+    void rast_draw_point(const Vertex& vertex);
     void rast_draw_line(const std::array<Vertex, 2>& vertices);
     void rast_draw_triangle(const std::array<Vertex, 3>& vertices);
 
+    enum class PassMode {
+        normal,
+        depth, // depth prepass, records primitives
+        shade, // replays the recorded primitives
+        measure // only accumulates the screen bounds of primitives
+    };
+
+    struct PrepassList {
+        std::vector<Vertex> points;
+        std::vector<std::array<Vertex, 2>> lines;
+        std::vector<std::array<Vertex, 3>> triangles;
+    };
+
+    virtual void replay_prepass();
+    [[nodiscard]] const PrepassList& prepass_list() const;
+
+    // test only, kept fragments are written with store_depth once the shader didn't discard them
     [[nodiscard]] virtual bool depth_test(ivec2 pos, float z);
     virtual void blend_color(ivec2 pos, Color& color);
+    virtual void blend_packed_color(ivec2 pos, ColorU32& color);
     virtual void set_color(ivec2 pos, const Color& color);
-    void call_fragment_shader(ivec2 pos, const Vertex& v);
+    virtual void set_packed_color(ivec2 pos, ColorU32 color);
+    bool call_fragment_shader(ivec2 pos, const Vertex& v); // false if discarded
+    [[nodiscard]] std::optional<ColorU32> shade_packed(const Vertex& v) const;
+    // shades once per block of the shading rate at pos, later fragments of the block reuse the result
+    [[nodiscard]] std::optional<ColorU32> shade_coarse(ivec2 pos, const Vertex& v) const;
+    [[nodiscard]] bool coarse_shading_enabled() const;
+    [[nodiscard]] int shading_rate_at(ivec2 pos) const;
+
+    // span versions used by the scanline walker, pos is the leftmost fragment
+    [[nodiscard]] virtual size_t depth_test_span(ivec2 pos, const float* depth, uint8_t* mask, int n);
+    virtual void store_depth(ivec2 pos, float z);
+    virtual void write_color_span(ivec2 pos, const ColorU32* colors, const uint8_t* mask, int n);
 
     [[nodiscard]] bool depth_test_enabled() const;
     [[nodiscard]] bool depth_write_enabled() const;
-    [[nodiscard]] bool check_depth(ivec2 pos, float z) const;
-    void write_depth(ivec2 pos, float z) const;
+    [[nodiscard]] bool early_depth_enabled() const;
+    [[nodiscard]] bool blend_enabled() const;
+    [[nodiscard]] float depth_far() const;
+    [[nodiscard]] float to_depth(float rz) const;
+    [[nodiscard]] bool check_depth(ivec2 pos, float z) const; // true if passed
+    void write_depth(ivec2 pos, float z);
 
 private:
     std::shared_ptr<Camera> camera;
@@ -107,25 +242,63 @@ private:
     Rasterizer rasterizer;
     VertexShader vertexShader;
     FragmentShader fragmentShader;
+    PackedFragmentShader packedFragmentShader;
+    InstanceVertexShader instanceVertexShader;
 
     std::shared_ptr<Uniform> uniform;
 
     FrameBuffer frame;
     Viewport viewport;
+    std::optional<Rect> scissor;
+
+    // typed views of the frame for the span path, null if the images are of other types
+    ImageRGBA8* colorTarget = nullptr;
+    ImageF32* depthTarget = nullptr;
 
     CullFace cullFace;
+    bool instanceCulling;
+
+    ShadingRate shadingRate;
+    std::shared_ptr<const ShadingRateImage> shadingRateImage;
 
     bool enableDepthTest;
     bool enableDepthWrite;
+    CompareOp depthCompare;
+    DepthConvention depthConvention;
     DepthFunc depthFunc;
 
     bool enableBlend;
+    BlendState blendState;
     BlendFunc blendFunc;
 
+    PassMode passMode = PassMode::normal;
+    bool prepassOpaque = false; // the depth pass skips the shader
+    std::vector<uint8_t> prepassShaded; // pixels the shade pass has taken, ties keep the first fragment
+    PrepassList prepass;
+    std::mutex prepassMutex;
+    Rect measured{};
+
+    void measure_primitive(std::span<const Vertex> v);
+
+    // strips and fans, every vertex is transformed once and only a window of two is kept
+    // Transformed ranges skip the vertex stage
+    template <bool Transformed = false, class R>
+    void draw_shared(R&& vertices, Topology topo);
+    // primitives over transformed vertices, index(i) is the vertex of the i-th of n indices
+    // a restart index ends the current primitive in every topology
+    template <class I>
+    void assemble_indexed(std::span<const Vertex> vertices, I&& index, size_t n, Topology topo);
+    template <class I>
+    void draw_instances(std::span<const Vertex> vertices, I&& index, size_t n, Topology topo,
+                        std::span<const InstanceData> instances);
+    void transform_instance(Vertex& v, const InstanceData& instance) const;
+
     float call_vertex_shader(Vertex& v) const;
     static void perspective_division(Vertex& v, float w);
     void viewport_transform(Vertex& v) const;
     [[nodiscard]] bool face_culling(const std::array<Vertex, 3>& v) const;
+    [[nodiscard]] Rect clip_rect() const;
+    [[nodiscard]] bool clip_rect_culling(std::span<const Vertex> v) const;
 
     [[nodiscard]] bool point_frustum_culling(const Vertex& v, float w) const;
     [[nodiscard]] bool line_frustum_culling(std::array<Vertex, 2>& l);
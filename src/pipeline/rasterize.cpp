@@ -57,6 +57,12 @@ struct Edge {
         float ty = y - A.pos.y;
         return ty / dy;
     }
+
+    [[nodiscard]] float x2t(float x) const {
+        float dx = B.pos.x - A.pos.x;
+        float tx = x - A.pos.x;
+        return tx / dx;
+    }
 };
 
 struct Trapezoid {
@@ -158,32 +164,39 @@ void Rasterizer::draw_point(const Vertex& v) {
 void Rasterizer::draw_line(const std::array<Vertex, 2>& v) {
     algo::LineDrawer drawer{(vec2)v[0].pos, (vec2)v[1].pos};
     algo::Edge edge{v[0], v[1]};
+    // interpolated along the major axis, y2t of a horizontal line divides by zero
+    const bool x_major = drawer.dx > drawer.dy;
     while (auto p = drawer.advance()) {
-        auto t = edge.y2t((float)p->y);
-        draw_point(lerp(v[0], v[1], t));
+        auto t = x_major ? edge.x2t((float)p->x) : edge.y2t((float)p->y);
+        auto f = lerp(v[0], v[1], t);
+        f.pos.x = (float)p->x;
+        f.pos.y = (float)p->y;
+        draw_point(f);
     }
 }
 
-void Rasterizer::draw_triangle(const std::array<Vertex, 3>& v, const Viewport& viewport) {
+void Rasterizer::draw_triangle(const std::array<Vertex, 3>& v, const Rect& clip) {
     for (auto&& i : algo::triangle2trapezoid(v))
-        if (i) draw_trapezoid(*i, viewport);
+        if (i) draw_trapezoid(*i, clip);
 }
 
-void Rasterizer::draw_scanline(const algo::Scanline& scanline, const Viewport& viewport) {
-    auto xmin = (float)viewport.x, xmax = (float)(viewport.x + viewport.w);
-    if (xmin > xmax) std::swap(xmin, xmax);
-    if (auto clipped = algo::scanline_clip(scanline, xmin - 1, xmax - 1)) // it offers (min, max], but we want [min, max)
-        while (auto v = clipped->advance())
-            draw_point(*v);
+void Rasterizer::draw_scanline(const algo::Scanline& scanline, const Rect& clip) {
+    auto xmin = (float)clip.x, xmax = (float)(clip.x + clip.w);
+    if (auto clipped = algo::scanline_clip(scanline, xmin - 1, xmax - 1)) { // it offers (min, max], but we want [min, max)
+        if (!span_callback)
+            while (auto v = clipped->advance())
+                draw_point(*v);
+        else if (clipped->width > 0)
+            span_callback(clipped->vertex + clipped->step, clipped->step, clipped->width);
+    }
 }
 
-void Rasterizer::draw_trapezoid(const algo::Trapezoid& trap, const Viewport& viewport) {
-    auto ymin = (float)viewport.y, ymax = (float)(viewport.y + viewport.h);
-    if (ymin > ymax) std::swap(ymin, ymax);
+void Rasterizer::draw_trapezoid(const algo::Trapezoid& trap, const Rect& clip) {
+    auto ymin = (float)clip.y, ymax = (float)(clip.y + clip.h);
     if (auto clipped = algo::trapezoid_clip(trap, ymin, ymax)) {
         for (int y = ceil(clipped->bottom), end = ceil(clipped->top); y < end; ++y) {
             auto scanline = algo::Scanline(*clipped, (float)y);
-            draw_scanline(scanline, viewport);
+            draw_scanline(scanline, clip);
         }
     }
 }
@@ -18,6 +18,8 @@ struct Trapezoid;
 }
 
 using FragmentShaderCallback = std::function<void(const Vertex&)>;
+// first fragment, step between fragments (exactly one pixel in x), fragment count
+using FragmentSpanCallback = std::function<void(const Vertex&, const Vertex&, int)>;
 
 struct RasterizerInitInfo {};
 
@@ -27,14 +29,16 @@ public:
 
     void draw_point(const Vertex&);
     void draw_line(const std::array<Vertex, 2>&);
-    void draw_triangle(const std::array<Vertex, 3>&, const Viewport&);
+    // clip is the normalized area fragments are generated in
+    void draw_triangle(const std::array<Vertex, 3>&, const Rect& clip);
 
-    void draw_scanline(const algo::Scanline&, const Viewport&);
-    void draw_trapezoid(const algo::Trapezoid&, const Viewport&);
+    void draw_scanline(const algo::Scanline&, const Rect& clip);
+    void draw_trapezoid(const algo::Trapezoid&, const Rect& clip);
 
 private:
 
     FragmentShaderCallback callback;
+    FragmentSpanCallback span_callback; // scanlines go per fragment through callback if not set
 
     friend class Pipeline;
 };
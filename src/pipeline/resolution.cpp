@@ -0,0 +1,46 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "resolution.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace cu {
+
+DynamicResolution::DynamicResolution(const Viewport& viewport, float min_scale)
+    : full(viewport), current(viewport), minScale(min_scale) {}
+
+void DynamicResolution::apply(Pipeline& pipe, float scale) {
+    currentScale = std::clamp(scale, minScale, 1.f);
+    auto area = full.rect();
+    auto w = std::max((int)std::lround((float)area.w * currentScale), 1);
+    auto h = std::max((int)std::lround((float)area.h * currentScale), 1);
+    // anchored at the corner of the full area, flipped axes start at the far edge
+    current = {
+        full.w < 0 ? area.x + w : area.x,
+        full.h < 0 ? area.y + h : area.y,
+        full.w < 0 ? -w : w,
+        full.h < 0 ? -h : h
+    };
+    pipe.set_viewport(current);
+}
+
+float DynamicResolution::scale() const {
+    return currentScale;
+}
+
+Rect DynamicResolution::rect() const {
+    return current.rect();
+}
+
+const Viewport& DynamicResolution::viewport() const {
+    return current;
+}
+
+void DynamicResolution::resolve(const ImageRGBA8& src, ImageRGBA8& dst, Filter filter) const {
+    resample(src, rect(), dst, filter);
+}
+
+}
@@ -0,0 +1,36 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "pipeline.hpp"
+#include "resample.hpp"
+
+namespace cu {
+
+// renders into a sub-rectangle of a full size target, resized every frame
+// nothing is reallocated, only the viewport shrinks; the scale usually comes from FramePacer::render_scale
+class DynamicResolution {
+public:
+    // `viewport` is the full resolution one, the frame buffer must cover it
+    explicit DynamicResolution(const Viewport& viewport, float min_scale = .25f);
+
+    // sets the viewport of pipe for a frame rendered at `scale` of the full size
+    // sizes are snapped to whole pixels, the pipeline must be idle
+    void apply(Pipeline& pipe, float scale);
+
+    [[nodiscard]] float scale() const;
+    // the area the current frame renders into, only this needs clearing
+    [[nodiscard]] Rect rect() const;
+    [[nodiscard]] const Viewport& viewport() const;
+
+    // stretches the rendered area of src over dst
+    void resolve(const ImageRGBA8& src, ImageRGBA8& dst, Filter filter = Filter::bilinear) const;
+
+private:
+    Viewport full, current;
+    float minScale, currentScale = 1.f;
+};
+
+}
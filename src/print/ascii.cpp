@@ -3,28 +3,413 @@
 //
 
 #include "ascii.hpp"
+#include "parallel.hpp"
 
-#include <numeric>
+#include <atomic>
+#include <thread>
+#include <cstring>
 #include <algorithm>
 
 namespace cu {
 
+namespace {
+
+// braille dots are numbered down the first column, then the second, the bottom row comes last
+// the glyph of a dot mask is U+2800 + mask
+constexpr uint8_t braille_bit[4][2] = {{0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}};
+
+constexpr auto braille_utf8 = [] {
+    std::array<uint32_t, 256> r{};
+    for (uint32_t m = 0; m < 256; m++) {
+        uint32_t cp = 0x2800 + m;
+        r[m] = (0xE0 | cp >> 12) | (0x80 | (cp >> 6 & 0x3F)) << 8 | (0x80 | (cp & 0x3F)) << 16;
+    }
+    return r;
+}();
+
+// indexed by (upper lit) | (lower lit) << 1: space, U+2580, U+2584, U+2588
+constexpr std::array<uint32_t, 4> half_utf8 = {' ', 0x8096E2, 0x8496E2, 0x8896E2};
+
+// luminance -> brightness with the 2.2 gamma of the default filter
+const std::array<uint8_t, 256>& gamma_lut() {
+    static const auto lut = [] {
+        std::array<uint8_t, 256> r{};
+        for (int i = 0; i < 256; i++)
+            r[i] = (uint8_t)std::lround(std::pow((float)i / 255.f, 2.2f) * 255.f);
+        return r;
+    }();
+    return lut;
+}
+
+struct StringSink {
+    std::string& out;
+
+    void operator()(char c) { out += c; }
+    void operator()(std::string_view s) { out += s; }
+};
+
+struct SpanSink {
+    std::span<char> out;
+    size_t n = 0;
+
+    void operator()(char c) {
+        if (n < out.size()) out[n++] = c;
+    }
+    void operator()(std::string_view s) {
+        auto k = std::min(s.size(), out.size() - n);
+        std::memcpy(out.data() + n, s.data(), k);
+        n += k;
+    }
+};
+
+}
+
 std::string AsciiFactory::process(const Image& img) {
-    if (enabled_noise)
-        return filter_pixels(cu::fetch_pixels_noised(img, noise_factor));
-    else
-        return filter_pixels(cu::fetch_pixels(img));
+    std::string out;
+    process_into(img, out);
+    return out;
 }
 
 std::string AsciiFactory::process(const Texture& tex, Extent ext) {
-    if (enabled_noise)
-        return filter_pixels(cu::pick_pixels_noised(tex, ext, noise_factor));
+    std::string out;
+    process_into(tex, ext, out);
+    return out;
+}
+
+void AsciiFactory::process_into(const Image& img, std::string& out) {
+    out.clear();
+    StringSink sink{out};
+    if (glyph_mode != GlyphMode::ascii) {
+        fill_subcells(img, false, subcells);
+        return emit_subcells(sink);
+    }
+    fill_glyphs(img);
+    out.reserve(glyphs.size());
+    emit_glyphs(sink);
+}
+
+void AsciiFactory::process_into(const Texture& tex, Extent ext, std::string& out) {
+    if (auto img = reduce(tex, ext * pixels_per_cell())) return process_into(*img, out);
+    out.clear();
+    StringSink sink{out};
+    if (glyph_mode != GlyphMode::ascii) {
+        fill_subcells(tex, ext, false, subcells);
+        return emit_subcells(sink);
+    }
+    fill_glyphs(tex, ext);
+    out.reserve(glyphs.size());
+    emit_glyphs(sink);
+}
+
+size_t AsciiFactory::process_into(const Image& img, std::span<char> out) {
+    SpanSink sink{out};
+    if (glyph_mode != GlyphMode::ascii) {
+        fill_subcells(img, false, subcells);
+        emit_subcells(sink);
+    } else {
+        fill_glyphs(img);
+        emit_glyphs(sink);
+    }
+    return sink.n;
+}
+
+size_t AsciiFactory::process_into(const Texture& tex, Extent ext, std::span<char> out) {
+    if (auto img = reduce(tex, ext * pixels_per_cell())) return process_into(*img, out);
+    SpanSink sink{out};
+    if (glyph_mode != GlyphMode::ascii) {
+        fill_subcells(tex, ext, false, subcells);
+        emit_subcells(sink);
+    } else {
+        fill_glyphs(tex, ext);
+        emit_glyphs(sink);
+    }
+    return sink.n;
+}
+
+void AsciiFactory::process_into(const Image& img, std::vector<Cell>& out) {
+    if (glyph_mode != GlyphMode::ascii) return fill_subcells(img, true, out);
+    fill_glyphs(img);
+    auto [w, h] = img.size().asArray;
+    out.resize(glyphs.size());
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            auto& cell = out[x + y * w];
+            cell.glyph = (uint8_t)glyphs[x + y * w];
+            cell.fg = img.get_packed(uivec2(x, y));
+            cell.bg = {};
+        }
+}
+
+void AsciiFactory::process_into(const Texture& tex, Extent ext, std::vector<Cell>& out) {
+    if (auto img = reduce(tex, ext * pixels_per_cell())) return process_into(*img, out);
+    if (glyph_mode != GlyphMode::ascii) return fill_subcells(tex, ext, true, out);
+    fill_glyphs(tex, ext);
+    out.resize(glyphs.size());
+    auto [w, h] = ext.asArray;
+    float rw = 1.f / w, rh = 1.f / h;
+    for (int i = 0; i < w * h; i++) {
+        // same uv as pick_pixels
+        auto e = (float)i * rw;
+        auto f = floor(e);
+        out[i].glyph = (uint8_t)glyphs[i];
+        out[i].fg = ColorU32{tex.get({e - f, f * rh})};
+        out[i].bg = {};
+    }
+}
+
+void AsciiFactory::fill_glyphs(const Image& img) {
+    auto [w, h] = img.size().asArray;
+    glyphs.resize(w * h);
+    kernel.build(table, dither_mode(), noise_factor);
+    if (is_error_diffusion(dither_mode())) {
+        brightness.resize(w * h);
+        if (!packed_rows(img, {0, 0, w, h}, [&](int y, const ColorU32* px) {
+            kernel.brightness_row(px, w, brightness.data() + y * w);
+        }))
+            for (size_t i = 0; auto&& col : cu::fetch_pixels(img)) brightness[i++] = to_brightness(col);
+        return diffuse_glyphs(w, h);
+    }
+    if (fused_glyphs(img, {0, 0, w, h}, glyphs.data())) return;
+    SpanSink sink{glyphs};
+    if (dither_mode() == DitherMode::noise)
+        filter_pixels(cu::fetch_pixels_noised(img, noise_factor), w, sink);
+    else
+        filter_pixels(cu::fetch_pixels(img), w, sink);
+}
+
+void AsciiFactory::fill_glyphs(const Texture& tex, Extent ext) {
+    auto [w, h] = ext.asArray;
+    glyphs.resize(w * h);
+    kernel.build(table, dither_mode(), noise_factor);
+    if (is_error_diffusion(dither_mode())) {
+        brightness.resize(w * h);
+        if (!packed_rows(tex, ext, {0, 0, w, h}, [&](int y, const ColorU32* px) {
+            kernel.brightness_row(px, w, brightness.data() + y * w);
+        }))
+            for (size_t i = 0; auto&& col : cu::pick_pixels(tex, ext)) brightness[i++] = to_brightness(col);
+        return diffuse_glyphs(w, h);
+    }
+    if (fused_glyphs(tex, ext, {0, 0, w, h}, glyphs.data())) return;
+    SpanSink sink{glyphs};
+    if (dither_mode() == DitherMode::noise)
+        filter_pixels(cu::pick_pixels_noised(tex, ext, noise_factor), w, sink);
     else
-        return filter_pixels(cu::pick_pixels(tex, ext));
+        filter_pixels(cu::pick_pixels(tex, ext), w, sink);
+}
+
+void AsciiFactory::diffuse_glyphs(int w, int h) {
+    errors.assign((size_t)(w + 4) * (h + 2), 0);
+    if (progress.size() != (size_t)h) progress = std::vector<std::atomic_int>(h);
+    for (auto&& p : progress) p.store(0, std::memory_order_relaxed);
+    // rows are claimed in order one at a time, so a row only ever waits for a running one
+    for_rows(0, h, [&](int y) {
+        kernel.diffuse_row(brightness.data() + y * w, w, y, glyphs.data() + y * w, errors.data(), progress.data());
+    }, 1);
+}
+
+std::vector<Rect> AsciiFactory::update(const Image& img, std::span<const Rect> damage, std::string& out) {
+    auto [w, h] = img.size().asArray;
+    // error diffusion carries across damage boundaries
+    if (converter || glyph_mode != GlyphMode::ascii || is_error_diffusion(dither_mode()) || out.size() != (size_t)(w * h)) {
+        process_into(img, out);
+        return {{0, 0, w, h}};
+    }
+    std::vector<Rect> cells;
+    for (auto&& rect : damage) {
+        auto r = cells.emplace_back(rect.intersect({0, 0, w, h}));
+        if (fused_glyphs(img, r, out.data())) continue;
+        for (int y = r.y; y < r.y + r.h; y++)
+            for (int x = r.x; x < r.x + r.w; x++) {
+                auto col = img.get(uivec2(x, y));
+                if (dither_mode() == DitherMode::noise) col += noise_factor * (float)get_blue_noise(x, y) / 255.f;
+                out[x + y * w] = to_char(col, x, y);
+            }
+    }
+    return cells;
+}
+
+std::vector<Rect> AsciiFactory::update(const Texture& tex, Extent ext, std::span<const Rect> damage, std::string& out) {
+    auto [w, h] = ext.asArray;
+    // an area reduction touches the whole grid anyway
+    if (converter || glyph_mode != GlyphMode::ascii || downsample == Downsample::area || source_rect
+        || is_error_diffusion(dither_mode()) || out.size() != (size_t)(w * h)) {
+        process_into(tex, ext, out);
+        return {{0, 0, w, h}};
+    }
+    std::vector<Rect> rewritten;
+    // image pixels -> cells, one cell of margin covers the rounding of samplers
+    auto src = tex.image->size();
+    float sx = (float)w / (float)src.x, sy = (float)h / (float)src.y;
+    float rw = 1.f / w, rh = 1.f / h;
+    for (auto&& rect : damage) {
+        int l = (int)std::floor((float)rect.x * sx) - 1, b = (int)std::floor((float)rect.y * sy) - 1;
+        int r = (int)std::ceil((float)(rect.x + rect.w) * sx) + 1, t = (int)std::ceil((float)(rect.y + rect.h) * sy) + 1;
+        auto cells = rewritten.emplace_back(Rect{l, b, r - l, t - b}.intersect({0, 0, w, h}));
+        if (fused_glyphs(tex, ext, cells, out.data())) continue;
+        for (int y = cells.y; y < cells.y + cells.h; y++)
+            for (int x = cells.x; x < cells.x + cells.w; x++) {
+                // same uv as pick_pixels
+                auto e = (float)(x + y * w) * rw;
+                auto f = floor(e);
+                vec2 uv(e - f, f * rh);
+                auto col = tex.get(uv);
+                if (dither_mode() == DitherMode::noise) col += noise_factor * get_blue_noise(uv.x * (w-1), uv.y * (h-1)) / 255.f;
+                out[x + y * w] = to_char(col, x, y);
+            }
+    }
+    return rewritten;
+}
+
+template <class F>
+bool AsciiFactory::packed_rows(const Image& img, const Rect& cells, F&& fn) {
+    auto src = dynamic_cast<const ImageRGBA8*>(&img);
+    if (filter || !src) return false;
+
+    for_rows(cells.y, cells.y + cells.h, [&](int y) {
+        fn(y, src->row(y) + cells.x);
+    });
+    return true;
+}
+
+template <class F>
+bool AsciiFactory::packed_rows(const Texture& tex, Extent ext, const Rect& cells, F&& fn) {
+    auto src = dynamic_cast<const ImageRGBA8*>(tex.image);
+    if (filter || !src || !dynamic_cast<const NearestSampler*>(tex.sampler)) return false;
+
+    // nearest sampling of a grid is separable, the source columns are shared by all rows
+    auto [w, h] = ext.asArray;
+    auto last = src->size_ - 1;
+    columns.resize(w);
+    for (int x = cells.x; x < cells.x + cells.w; x++)
+        columns[x] = (int)std::round((float)x / (float)w * (float)last.x);
+    for_rows(cells.y, cells.y + cells.h, [&](int y) {
+        thread_local std::vector<ColorU32> row;
+        row.resize(cells.w);
+        auto sr = src->row((uint32_t)std::round((float)y / (float)h * (float)last.y));
+        for (int x = 0; x < cells.w; x++)
+            row[x] = sr[columns[cells.x + x]];
+        fn(y, row.data());
+    });
+    return true;
+}
+
+bool AsciiFactory::fused_glyphs(const Image& img, const Rect& cells, char* out) {
+    kernel.build(table, dither_mode(), noise_factor);
+    auto w = img.size().x;
+    return packed_rows(img, cells, [&](int y, const ColorU32* px) {
+        kernel.convert_row(px, cells.w, cells.x, y, out + y * w + cells.x);
+    });
+}
+
+bool AsciiFactory::fused_glyphs(const Texture& tex, Extent ext, const Rect& cells, char* out) {
+    kernel.build(table, dither_mode(), noise_factor);
+    return packed_rows(tex, ext, cells, [&](int y, const ColorU32* px) {
+        kernel.convert_row(px, cells.w, cells.x, y, out + y * ext.x + cells.x);
+    });
+}
+
+const ImageRGBA8* AsciiFactory::reduce(const Texture& tex, Extent grid) {
+    auto src = dynamic_cast<const ImageRGBA8*>(tex.image);
+    if ((downsample != Downsample::area && !source_rect) || !src) return nullptr;
+    if (!reduced || reduced->size() != grid) reduced = std::make_unique<ImageRGBA8>(grid);
+    downsample_area(*src, source_rect.value_or(Rect{0, 0, src->size_.x, src->size_.y}), *reduced);
+    return reduced.get();
+}
+
+template <class Sink>
+void AsciiFactory::emit_glyphs(Sink& sink) {
+    if (converter) {
+        if (interned_table != table) intern();
+        for (auto&& c : glyphs)
+            sink(std::string_view{interned[(uint8_t)c]});
+    } else {
+        sink(std::string_view{glyphs});
+    }
+}
+
+template <class Fetch>
+void AsciiFactory::fill_subcells(Extent cells, bool colored, std::vector<Cell>& out, Fetch&& fetch) {
+    auto [w, h] = cells.asArray;
+    out.resize(w * h);
+    const auto& gamma = gamma_lut();
+    // a dot is lit when its brightness exceeds the threshold of the ordered tile, 127 without one
+    kernel.build(table, dither_mode(), noise_factor);
+    auto lit = [&](ColorU32 c, int x, int y) {
+        int v = filter ? (int)(std::clamp(filter(unpack_color(c)), 0.f, 1.f) * 255.f)
+                       : gamma[(77u * c.r + 150u * c.g + 29u * c.b + 128u) >> 8];
+        return v > (int)kernel.threshold(x, y);
+    };
+
+    for_rows(0, h, [&](int cy) {
+        for (int cx = 0; cx < w; cx++) {
+            auto& cell = out[cx + cy * w];
+            cell.bg = {};
+            if (glyph_mode == GlyphMode::braille) {
+                uint32_t mask = 0, on = 0, sum[3]{}, all[3]{};
+                for (int dy = 0; dy < 4; dy++)
+                    for (int dx = 0; dx < 2; dx++) {
+                        int x = cx * 2 + dx, y = cy * 4 + dy;
+                        auto c = fetch(x, y);
+                        for (int k = 0; k < 3; k++) all[k] += c[k];
+                        if (!lit(c, x, y)) continue;
+                        mask |= braille_bit[dy][dx];
+                        for (int k = 0; k < 3; k++) sum[k] += c[k];
+                        ++on;
+                    }
+                cell.glyph = braille_utf8[mask];
+                cell.fg = on ? ColorU32(sum[0] / on, sum[1] / on, sum[2] / on, 255)
+                             : ColorU32(all[0] / 8, all[1] / 8, all[2] / 8, 255);
+            } else {
+                auto top = fetch(cx, cy * 2), bottom = fetch(cx, cy * 2 + 1);
+                if (colored) {
+                    cell.glyph = half_utf8[1];
+                    cell.fg = {top.r, top.g, top.b, 255};
+                    cell.bg = {bottom.r, bottom.g, bottom.b, 255};
+                } else {
+                    cell.glyph = half_utf8[lit(top, cx, cy * 2) | lit(bottom, cx, cy * 2 + 1) << 1];
+                    cell.fg = {255, 255, 255, 255};
+                }
+            }
+        }
+    });
+}
+
+void AsciiFactory::fill_subcells(const Image& img, bool colored, std::vector<Cell>& out) {
+    fill_subcells(img.size() / pixels_per_cell(), colored, out, [&](int x, int y) {
+        return img.get_packed(uivec2(x, y));
+    });
+}
+
+void AsciiFactory::fill_subcells(const Texture& tex, Extent ext, bool colored, std::vector<Cell>& out) {
+    auto sub = ext * pixels_per_cell();
+    float rw = 1.f / (float)sub.x, rh = 1.f / (float)sub.y;
+    fill_subcells(ext, colored, out, [&](int x, int y) {
+        return ColorU32{tex.get({(float)x * rw, (float)y * rh})};
+    });
+}
+
+template <class Sink>
+void AsciiFactory::emit_subcells(Sink& sink) {
+    for (auto&& cell : subcells) {
+        char utf8[4];
+        int n = 0;
+        for (auto g = cell.glyph; g; g >>= 8) utf8[n++] = char(g & 255);
+        sink(std::string_view{utf8, (size_t)n});
+    }
+}
+
+template <class F>
+void AsciiFactory::for_rows(int b, int e, F&& fn, int chunk) const {
+    int chunks = (e - b + chunk - 1) / chunk;
+    int workers = pool_workers > 0 ? pool_workers : (int)std::thread::hardware_concurrency();
+    parallel_for(thread_pool, workers, chunks, [&](int c) {
+        for (int y = b + c * chunk; y < std::min(e, b + (c + 1) * chunk); y++) fn(y);
+    });
 }
 
 AsciiFactory& AsciiFactory::set_table(const std::string& tb) {
     table = tb + tb.back();
+    interned_table.clear();
     return *this;
 }
 
@@ -43,8 +428,48 @@ AsciiFactory& AsciiFactory::set_filter(const std::function<float(const Color&)>&
     return *this;
 }
 
+AsciiFactory& AsciiFactory::set_thread_pool(st::ThreadPool* pool, int workers) {
+    thread_pool = pool;
+    pool_workers = workers;
+    return *this;
+}
+
+AsciiFactory& AsciiFactory::set_glyph_mode(GlyphMode mode) {
+    glyph_mode = mode;
+    return *this;
+}
+
+Extent AsciiFactory::pixels_per_cell() const {
+    switch (glyph_mode) {
+        case GlyphMode::braille:    return {2, 4};
+        case GlyphMode::half_block: return {1, 2};
+        default:                    return {1, 1};
+    }
+}
+
+AsciiFactory& AsciiFactory::set_downsample(Downsample mode) {
+    downsample = mode;
+    return *this;
+}
+
+AsciiFactory& AsciiFactory::set_source_rect(const std::optional<Rect>& rect) {
+    source_rect = rect;
+    return *this;
+}
+
+AsciiFactory& AsciiFactory::set_dither(DitherMode mode) {
+    dither = mode;
+    return *this;
+}
+
+DitherMode AsciiFactory::dither_mode() const {
+    if (dither != DitherMode::none) return dither;
+    return enabled_noise ? DitherMode::noise : DitherMode::none;
+}
+
 AsciiFactory& AsciiFactory::set_converter(const std::function<std::string(char)>& convert) {
     converter = convert;
+    interned_table.clear();
     return *this;
 }
 
@@ -53,33 +478,38 @@ char AsciiFactory::get_char(float v) const {
     return table[(size_t)(v * l)];
 }
 
-template <class View>
-std::string AsciiFactory::filter_pixels(const View& view) const {
-    if (filter) {
-        auto filtered = view | std::views::transform([this](auto&& col) -> char {
-            auto f = filter(col);
-            return get_char(std::clamp(f, 0.f, 1.f));
-        });
-        return convert_pixels(filtered);
-    } else {
-        auto filtered = view | std::views::transform([this](auto&& col) -> char {
-            auto f = GetColorFeatureValue(col, ColorFeature::GRS); // default
-            return get_char(std::clamp(std::pow(f, 2.2f), 0.f, 1.f));
-        });
-        return convert_pixels(filtered);
-    }
+char AsciiFactory::to_char(const Color& col) const {
+    if (filter)
+        return get_char(std::clamp(filter(col), 0.f, 1.f));
+    auto f = GetColorFeatureValue(col, ColorFeature::GRS); // default
+    return get_char(std::clamp(std::pow(f, 2.2f), 0.f, 1.f));
 }
 
-template <class View>
-std::string AsciiFactory::convert_pixels(const View& view) const {
-    if (converter) {
-        auto converted = view | std::views::transform([this](auto&& c) {
-            return converter(c);
-        });
-        return std::accumulate(converted.begin(), converted.end(), std::string());
-    } else {
-        return std::accumulate(view.begin(), view.end(), std::string());
+char AsciiFactory::to_char(const Color& col, int x, int y) const {
+    auto mode = dither_mode();
+    if (mode == DitherMode::blue_noise || mode == DitherMode::bayer)
+        return kernel.quantize(to_brightness(col), x, y);
+    return to_char(col);
+}
+
+uint8_t AsciiFactory::to_brightness(const Color& col) const {
+    auto v = filter ? filter(col) : std::pow(GetColorFeatureValue(col, ColorFeature::GRS), 2.2f);
+    return (uint8_t)std::lround(std::clamp(v, 0.f, 1.f) * 255.f);
+}
+
+void AsciiFactory::intern() {
+    for (auto&& c : table)
+        interned[(uint8_t)c] = converter(c);
+    interned_table = table;
+}
+
+template <class View, class Sink>
+void AsciiFactory::filter_pixels(const View& view, int width, Sink& sink) {
+    int i = 0;
+    for (auto&& col : view) {
+        sink(to_char(col, i % width, i / width));
+        ++i;
     }
 }
 
-}
\ No newline at end of file
+}
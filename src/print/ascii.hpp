@@ -4,10 +4,17 @@
 
 #pragma once
 
+#include <span>
+#include <array>
 #include <ranges>
+#include <optional>
 #include <functional>
 
 #include "core.hpp"
+#include "resample.hpp"
+#include "cell.hpp"
+#include "glyph.hpp"
+#include "sethread.h"
 #include "blue_noise.h"
 
 namespace cu {
@@ -52,33 +59,136 @@ inline auto pick_pixels_noised(const Texture& img, Extent size, float k = .5f) {
     });
 }
 
+enum class GlyphMode {
+    ascii,     // one table char per pixel
+    braille,   // 2x4 pixels per cell, dithered dots colored by their average
+    half_block // 1x2 pixels per cell, fg paints the upper and bg the lower half
+};
+
+enum class Downsample {
+    point, // one sample per cell through the texture's sampler
+    area   // average of all the covered pixels, for RGBA8 textures
+};
+
 struct AsciiFactory {
     AsciiFactory() = default;
 
     std::string process(const Image& img);
     std::string process(const Texture& tex, Extent ext);
 
+    // reuse the capacity of `out`, no allocation once it is large enough
+    void process_into(const Image& img, std::string& out);
+    void process_into(const Texture& tex, Extent ext, std::string& out);
+    // writes at most out.size() bytes, returns the number written
+    size_t process_into(const Image& img, std::span<char> out);
+    size_t process_into(const Texture& tex, Extent ext, std::span<char> out);
+    // glyphs colored by the sampled pixels, for printers with a color mode, the converter is not used
+    // in the sub-cell modes an image yields size / pixels_per_cell() cells
+    void process_into(const Image& img, std::vector<Cell>& out);
+    void process_into(const Texture& tex, Extent ext, std::vector<Cell>& out);
+
+    // re-converts only the cells covered by `damage` (in image pixels) of a previous result
+    // falls back to a full conversion when a converter is set or the sizes don't match
+    // returns the rewritten cells
+    std::vector<Rect> update(const Image& img, std::span<const Rect> damage, std::string& out);
+    std::vector<Rect> update(const Texture& tex, Extent ext, std::span<const Rect> damage, std::string& out);
+
     AsciiFactory& set_table(const std::string& table);
     AsciiFactory& set_noise_enable(bool enable);
     AsciiFactory& set_noise_factor(float factor);
     AsciiFactory& set_filter(const std::function<float(const Color&)>& filter);
+    // the output is cached per table char
     AsciiFactory& set_converter(const std::function<std::string(char)>& convert);
+    // rows are converted in parallel when set, `workers` is the thread count of the pool,
+    // 0 takes the hardware concurrency
+    AsciiFactory& set_thread_pool(st::ThreadPool* pool, int workers = 0);
+    AsciiFactory& set_glyph_mode(GlyphMode mode);
+    AsciiFactory& set_downsample(Downsample mode);
+    // textures are read from this area only, it is always reduced by area
+    // e.g. the rect of DynamicResolution
+    AsciiFactory& set_source_rect(const std::optional<Rect>& rect);
+    // takes over from the noise switch unless none
+    AsciiFactory& set_dither(DitherMode mode);
+
+    [[nodiscard]] Extent pixels_per_cell() const;
 
     std::string table = " .:++";
     bool enabled_noise = false;
     float noise_factor = .5f;
     std::function<float(const Color&)> filter = nullptr;
-    std::function<std::string(char)> converter = nullptr;
+    st::ThreadPool* thread_pool = nullptr;
+    GlyphMode glyph_mode = GlyphMode::ascii;
+    Downsample downsample = Downsample::point;
+    std::optional<Rect> source_rect = std::nullopt;
+    DitherMode dither = DitherMode::none;
 
 private:
 
     [[nodiscard]] char get_char(float v) const;
-
-    template <class View>
-    std::string filter_pixels(const View& view) const;
-
-    template <class View>
-    std::string convert_pixels(const View& view) const;
+    [[nodiscard]] char to_char(const Color& col) const;
+    // x, y are the cell coordinates, they address the ordered dither tiles
+    [[nodiscard]] char to_char(const Color& col, int x, int y) const;
+    [[nodiscard]] uint8_t to_brightness(const Color& col) const;
+    [[nodiscard]] DitherMode dither_mode() const;
+
+    void intern();
+
+    // table chars of every cell into `glyphs`
+    void fill_glyphs(const Image& img);
+    void fill_glyphs(const Texture& tex, Extent ext);
+
+    // width is the row length of the view
+    template <class View, class Sink>
+    void filter_pixels(const View& view, int width, Sink& sink);
+
+    // RGBA8 sources with the default filter, fn(y, px) gets the packed pixels of the cells of row y
+    // false when it does not apply
+    template <class F>
+    bool packed_rows(const Image& img, const Rect& cells, F&& fn);
+    template <class F>
+    bool packed_rows(const Texture& tex, Extent ext, const Rect& cells, F&& fn);
+
+    // fused path, writes the glyphs of `cells` into out, whose pitch is the width of the result
+    bool fused_glyphs(const Image& img, const Rect& cells, char* out);
+    bool fused_glyphs(const Texture& tex, Extent ext, const Rect& cells, char* out);
+
+    template <class Sink>
+    void emit_glyphs(Sink& sink);
+
+    // braille / half-block cells, fetch(x, y) returns the packed pixel of the sub-cell grid
+    // without colors half blocks are thresholded like braille dots
+    template <class Fetch>
+    void fill_subcells(Extent cells, bool colored, std::vector<Cell>& out, Fetch&& fetch);
+    void fill_subcells(const Image& img, bool colored, std::vector<Cell>& out);
+    void fill_subcells(const Texture& tex, Extent ext, bool colored, std::vector<Cell>& out);
+
+    template <class Sink>
+    void emit_subcells(Sink& sink);
+
+    // error diffusion of `brightness` into `glyphs`, rows run as a wavefront
+    void diffuse_glyphs(int w, int h);
+
+    template <class F>
+    void for_rows(int b, int e, F&& fn, int chunk = 8) const;
+
+    // the texture reduced to `grid` pixels by area, nullptr when not applicable
+    const ImageRGBA8* reduce(const Texture& tex, Extent grid);
+
+    GlyphKernel kernel;
+    std::unique_ptr<ImageRGBA8> reduced;
+    std::string glyphs;
+    std::vector<Cell> subcells;
+    std::vector<int> columns;
+    std::vector<uint8_t> brightness;
+    std::vector<int32_t> errors;
+    std::vector<std::atomic_int> progress;
+
+    int pool_workers = 0;
+    // only set through set_converter, which drops the cached output
+    std::function<std::string(char)> converter = nullptr;
+    // converter output of every table char
+    std::array<std::string, 256> interned;
+    std::string interned_table;
 };
 
 }
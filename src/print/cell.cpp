@@ -0,0 +1,105 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "cell.hpp"
+
+#include <array>
+#include <limits>
+
+namespace cu {
+
+namespace {
+
+constexpr uint8_t cube_levels[6] = {0, 95, 135, 175, 215, 255};
+
+std::array<uint8_t, 3> palette_rgb(int index) {
+    if (index >= 232) {
+        auto v = (uint8_t)(8 + (index - 232) * 10);
+        return {v, v, v};
+    }
+    index -= 16;
+    return {cube_levels[index / 36], cube_levels[index / 6 % 6], cube_levels[index % 6]};
+}
+
+const std::array<uint8_t, 32768>& palette_lut() {
+    static const auto lut = [] {
+        std::array<uint8_t, 32768> r{};
+        std::array<std::array<uint8_t, 3>, 240> pal;
+        for (int i = 0; i < 240; i++) pal[i] = palette_rgb(i + 16);
+        for (int i = 0; i < 32768; i++) {
+            // bucket centers
+            int c[3] = {(i >> 10 & 31) * 8 + 4, (i >> 5 & 31) * 8 + 4, (i & 31) * 8 + 4};
+            int best = 0, dist = std::numeric_limits<int>::max();
+            for (int p = 0; p < 240; p++) {
+                int d = 0;
+                for (int k = 0; k < 3; k++) d += (c[k] - pal[p][k]) * (c[k] - pal[p][k]);
+                if (d < dist) dist = d, best = p;
+            }
+            r[i] = (uint8_t)(best + 16);
+        }
+        return r;
+    }();
+    return lut;
+}
+
+void append_uint(std::string& out, uint32_t v) {
+    char buf[10];
+    int n = 0;
+    do buf[n++] = char('0' + v % 10); while (v /= 10);
+    while (n) out += buf[--n];
+}
+
+void append_color(std::string& out, ColorMode mode, uint32_t color, bool background) {
+    out += background ? "4" : "3";
+    if (color == CellCode::default_color) {
+        out += '9';
+    } else if (mode == ColorMode::palette256) {
+        out += "8;5;";
+        append_uint(out, color);
+    } else {
+        out += "8;2;";
+        append_uint(out, color >> 16 & 255);
+        out += ';';
+        append_uint(out, color >> 8 & 255);
+        out += ';';
+        append_uint(out, color & 255);
+    }
+}
+
+}
+
+uint8_t palette256(ColorU32 color) {
+    return palette_lut()[(color.r >> 3) << 10 | (color.g >> 3) << 5 | color.b >> 3];
+}
+
+SgrEncoder::SgrEncoder(ColorMode mode) : mode(mode) {}
+
+CellCode SgrEncoder::encode(const Cell& cell) const {
+    auto color = [this](ColorU32 c) -> uint32_t {
+        if (mode == ColorMode::none || c.a == 0) return CellCode::default_color;
+        if (mode == ColorMode::palette256) return palette256(c);
+        return (uint32_t)c.r << 16 | (uint32_t)c.g << 8 | c.b;
+    };
+    return {cell.glyph, color(cell.fg), color(cell.bg)};
+}
+
+void SgrEncoder::append(std::string& out, const CellCode& code) {
+    if (code.fg != fg || code.bg != bg) {
+        out += "\033[";
+        if (code.fg != fg) append_color(out, mode, code.fg, false);
+        if (code.fg != fg && code.bg != bg) out += ';';
+        if (code.bg != bg) append_color(out, mode, code.bg, true);
+        out += 'm';
+        fg = code.fg, bg = code.bg;
+    }
+    for (auto g = code.glyph; g; g >>= 8)
+        out += char(g & 255);
+}
+
+void SgrEncoder::reset(std::string& out) {
+    if (fg != CellCode::default_color || bg != CellCode::default_color) out += "\033[0m";
+    fg = bg = CellCode::default_color;
+}
+
+}
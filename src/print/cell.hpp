@@ -0,0 +1,56 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "core.hpp"
+
+#include <string>
+
+namespace cu {
+
+enum class ColorMode {
+    none,       // glyphs only
+    palette256, // xterm 6x6x6 cube and gray ramp
+    truecolor
+};
+
+// one terminal cell, the glyph is utf-8 packed from the lowest byte
+struct Cell {
+    uint32_t glyph = ' ';
+    ColorU32 fg{255, 255, 255, 255};
+    ColorU32 bg{0, 0, 0, 0}; // alpha 0 keeps the terminal background
+};
+
+// nearest xterm palette entry (16..255), through a 32x32x32 LUT
+[[nodiscard]] uint8_t palette256(ColorU32 color);
+
+// a cell reduced to what the terminal shows in a color mode, equal codes look the same
+struct CellCode {
+    static constexpr uint32_t default_color = ~0u;
+
+    uint32_t glyph;
+    uint32_t fg, bg; // 0xRRGGBB or a palette index
+
+    bool operator==(const CellCode&) const = default;
+};
+
+// emits SGR sequences only when the colors change between consecutive cells
+class SgrEncoder {
+public:
+    explicit SgrEncoder(ColorMode mode = ColorMode::truecolor);
+
+    [[nodiscard]] CellCode encode(const Cell& cell) const;
+
+    void append(std::string& out, const CellCode& code);
+    // back to the default colors, needed before anything else is written
+    void reset(std::string& out);
+
+    ColorMode mode;
+
+private:
+    uint32_t fg = CellCode::default_color, bg = CellCode::default_color;
+};
+
+}
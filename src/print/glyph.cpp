@@ -0,0 +1,201 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#include "glyph.hpp"
+#include "blue_noise.h"
+
+#include <cmath>
+#include <thread>
+#include <algorithm>
+
+namespace cu {
+
+namespace {
+
+// 0..63, the bits of x ^ y and y interleaved and reversed
+constexpr auto bayer8 = [] {
+    std::array<std::array<uint8_t, 8>, 8> m{};
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++) {
+            int a = x ^ y, r = 0;
+            for (int i = 0; i < 3; i++)
+                r |= (a >> i & 1) << (5 - 2 * i) | (y >> i & 1) << (4 - 2 * i);
+            m[y][x] = (uint8_t)r;
+        }
+    return m;
+}();
+
+}
+
+void GlyphKernel::build(std::string_view tb, DitherMode md, float k, float g) {
+    if (!lut.empty() && table == tb && mode == md && factor == k && gamma == g) return;
+    table = tb, mode = md, factor = k, gamma = g;
+
+    // the float path adds k * n / 255 to every channel, the luminance weights sum up to 1
+    // so in units of 1/255 the same offset is added to the luminance
+    tile.assign(tile_size * tile_pitch, 0);
+    int lo = 0, hi = 0;
+    if (mode == DitherMode::noise) {
+        for (int y = 0; y < tile_size; y++)
+            for (int x = 0; x < tile_pitch; x++) {
+                auto q = (int)std::lround(k * (float)get_blue_noise(x % tile_size, y));
+                tile[y * tile_pitch + x] = q;
+                lo = std::min(lo, q), hi = std::max(hi, q);
+            }
+        for (auto&& i : tile) i -= lo;
+    }
+
+    const auto l = float(table.length() - 1);
+    lut.resize(256 + hi - lo);
+    for (size_t i = 0; i < lut.size(); i++) {
+        auto v = std::max((float)((int)i + lo) / 255.f, 0.f);
+        lut[i] = table[(size_t)(std::clamp(std::pow(v, gamma), 0.f, 1.f) * l)];
+    }
+
+    for (int i = 0; i < 256; i++) {
+        gamma8[i] = (uint8_t)std::lround(std::pow((float)i / 255.f, gamma) * 255.f);
+        auto v = (float)i / 255.f * l;
+        auto base = std::floor(v);
+        levels[i] = (uint16_t)((int)base << 8 | std::min((int)((v - base) * 256.f), 255));
+    }
+
+    thresholds.assign(tile_size * tile_size, 127);
+    if (mode == DitherMode::noise || mode == DitherMode::blue_noise) {
+        for (int y = 0; y < tile_size; y++)
+            for (int x = 0; x < tile_size; x++)
+                thresholds[y * tile_size + x] = get_blue_noise(x, y);
+    } else if (mode == DitherMode::bayer) {
+        for (int y = 0; y < tile_size; y++)
+            for (int x = 0; x < tile_size; x++)
+                thresholds[y * tile_size + x] = (uint8_t)(bayer8[y & 7][x & 7] * 4 + 2);
+    }
+}
+
+template <bool Offset, class F>
+void GlyphKernel::for_luminance(const ColorU32* px, size_t n, int x, const int32_t* nrow, F&& fn) const {
+    size_t i = 0;
+
+#ifdef CU_ENABLED_SIMD
+    // luminance = (77r + 150g + 29b + 128) >> 8
+    alignas(32) int32_t idx[8];
+#ifdef __AVX2__
+    {
+        const auto w = _mm256_set_epi16(0, 29, 150, 77, 0, 29, 150, 77, 0, 29, 150, 77, 0, 29, 150, 77);
+        const auto z = _mm256_setzero_si256();
+        for (; i + 8 <= n; i += 8) {
+            auto p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(px + i));
+            // per lane: lo holds pixels 0,1 and hi pixels 2,3, the shuffles restore the order
+            auto lo = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpacklo_epi8(p, z), w));
+            auto hi = _mm256_castsi256_ps(_mm256_madd_epi16(_mm256_unpackhi_epi8(p, z), w));
+            auto rg = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            auto b = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+            auto lum = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(rg, b), _mm256_set1_epi32(128)), 8);
+            if constexpr (Offset)
+                lum = _mm256_add_epi32(lum, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(nrow + ((x + i) & (tile_size - 1)))));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(idx), lum);
+            for (int k = 0; k < 8; k++) fn(i + k, idx[k]);
+        }
+    }
+#endif
+    {
+        const auto w = _mm_set_epi16(0, 29, 150, 77, 0, 29, 150, 77);
+        const auto z = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            auto p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(px + i));
+            auto lo = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(p, z), w));
+            auto hi = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(p, z), w));
+            auto rg = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+            auto b = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+            auto lum = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(rg, b), _mm_set1_epi32(128)), 8);
+            if constexpr (Offset)
+                lum = _mm_add_epi32(lum, _mm_loadu_si128(reinterpret_cast<const __m128i*>(nrow + ((x + i) & (tile_size - 1)))));
+            _mm_store_si128(reinterpret_cast<__m128i*>(idx), lum);
+            for (int k = 0; k < 4; k++) fn(i + k, idx[k]);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        auto c = px[i];
+        int lum = (int)((77u * c.r + 150u * c.g + 29u * c.b + 128u) >> 8);
+        if constexpr (Offset) lum += nrow[(x + i) & (tile_size - 1)];
+        fn(i, lum);
+    }
+}
+
+void GlyphKernel::convert_row(const ColorU32* px, size_t n, int x, int y, char* out) const {
+    if (mode == DitherMode::blue_noise || mode == DitherMode::bayer) {
+        const uint8_t* trow = thresholds.data() + (y & (tile_size - 1)) * tile_size;
+        for_luminance<false>(px, n, 0, nullptr, [&](size_t i, int lum) {
+            auto e = levels[gamma8[lum]];
+            out[i] = table[(e >> 8) + ((e & 255) > trow[(x + i) & (tile_size - 1)])];
+        });
+    } else {
+        const int32_t* nrow = tile.data() + (y & (tile_size - 1)) * tile_pitch;
+        const char* l = lut.data();
+        for_luminance<true>(px, n, x, nrow, [&](size_t i, int v) {
+            out[i] = l[v];
+        });
+    }
+}
+
+void GlyphKernel::brightness_row(const ColorU32* px, size_t n, uint8_t* out) const {
+    for_luminance<false>(px, n, 0, nullptr, [&](size_t i, int lum) {
+        out[i] = gamma8[lum];
+    });
+}
+
+char GlyphKernel::quantize(uint8_t b, int x, int y) const {
+    auto e = levels[b];
+    if (mode == DitherMode::blue_noise || mode == DitherMode::bayer)
+        return table[(e >> 8) + ((e & 255) > threshold(x, y))];
+    return table[e >> 8];
+}
+
+uint8_t GlyphKernel::threshold(int x, int y) const {
+    return thresholds[(y & (tile_size - 1)) * tile_size + (x & (tile_size - 1))];
+}
+
+void GlyphKernel::diffuse_row(const uint8_t* bright, int w, int y, char* out, int32_t* err, std::atomic_int* progress) const {
+    const int l = (int)table.length() - 1;
+    const int pitch = w + 4;
+    // errors are in 1/256 of a brightness step, the ones to the right stay in registers
+    // so the shared rows below are only ever written by one row at a time
+    const int32_t* e0 = err + y * pitch + 2;
+    int32_t* e1 = err + (y + 1) * pitch + 2;
+    int32_t* e2 = e1 + pitch;
+    int32_t c1 = 0, c2 = 0;
+
+    int ready = y > 0 ? 0 : w;
+    for (int x = 0; x < w; x++) {
+        // the row above must have left the cells whose error reaches here
+        while (ready < std::min(x + 2, w)) {
+            ready = progress[y - 1].load(std::memory_order_acquire);
+            if (ready < std::min(x + 2, w)) std::this_thread::yield();
+        }
+
+        int v = bright[x] * 256 + e0[x] + c1;
+        int level = std::clamp((v * l + 255 * 128) / (255 * 256), 0, l);
+        int d = v - level * 255 * 256 / l;
+        out[x] = table[level];
+
+        if (mode == DitherMode::floyd_steinberg) {
+            c1 = d * 7 / 16;
+            e1[x - 1] += d * 3 / 16;
+            e1[x] += d * 5 / 16;
+            e1[x + 1] += d / 16;
+        } else {
+            int q = d / 8;
+            c1 = c2 + q, c2 = q;
+            e1[x - 1] += q;
+            e1[x] += q;
+            e1[x + 1] += q;
+            e2[x] += q;
+        }
+        if ((x & 7) == 7) progress[y].store(x + 1, std::memory_order_release);
+    }
+    progress[y].store(w, std::memory_order_release);
+}
+
+}
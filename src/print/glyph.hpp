@@ -0,0 +1,72 @@
+//
+// Created by Ninter6 on 2026/10/19.
+//
+
+#pragma once
+
+#include "core.hpp"
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <string_view>
+
+namespace cu {
+
+enum class DitherMode {
+    none,
+    noise,           // blue noise added to the luminance, scaled by the noise factor
+    blue_noise,      // ordered, thresholds from the 64x64 blue noise tile
+    bayer,           // ordered, thresholds from the 8x8 Bayer matrix
+    floyd_steinberg, // error diffusion
+    atkinson         // error diffusion, only 3/4 of the error is spread which keeps more contrast
+};
+
+[[nodiscard]] constexpr bool is_error_diffusion(DitherMode mode) {
+    return mode == DitherMode::floyd_steinberg || mode == DitherMode::atkinson;
+}
+
+// fused RGBA8 -> glyph conversion
+// fixed-point luminance plus a blue noise offset indexes a single LUT holding both the gamma curve and the glyph table
+// the ordered modes look up a level and its fraction instead, which one compare against the threshold tile rounds
+class GlyphKernel {
+public:
+    // rebuilds the tables only when a parameter changed
+    void build(std::string_view table, DitherMode mode, float noise_factor, float gamma = 2.2f);
+
+    // x, y are the cell coordinates of px[0], they address the tiles
+    // error diffusion modes are converted as none here
+    void convert_row(const ColorU32* px, size_t n, int x, int y, char* out) const;
+
+    // gamma corrected luminance in 0..255
+    void brightness_row(const ColorU32* px, size_t n, uint8_t* out) const;
+    // one cell of a brightness, ordered modes are dithered and the others are rounded down
+    [[nodiscard]] char quantize(uint8_t b, int x, int y) const;
+    // 0..255, 127 for the modes without a threshold tile
+    [[nodiscard]] uint8_t threshold(int x, int y) const;
+
+    // error diffusion of row y of a w x h brightness grid
+    // `err` holds (w + 4) * (h + 2) zeroed ints, progress[y] counts the finished cells of row y
+    // a row trails the one above by two cells, so rows can run on different threads at once
+    void diffuse_row(const uint8_t* bright, int w, int y, char* out, int32_t* err, std::atomic_int* progress) const;
+
+private:
+    static constexpr int tile_size = 64;
+    static constexpr int tile_pitch = tile_size + 8; // padded so 8 lanes can be loaded from any column
+
+    template <bool Offset, class F>
+    void for_luminance(const ColorU32* px, size_t n, int x, const int32_t* nrow, F&& fn) const;
+
+    std::string table;
+    DitherMode mode = DitherMode::none;
+    float factor = 0.f, gamma = 0.f;
+
+    std::vector<char> lut;          // indexed by luminance + noise offset
+    std::vector<int32_t> tile;      // noise offsets, already biased to be non-negative
+    std::vector<uint8_t> thresholds; // tile_size * tile_size
+    std::array<uint8_t, 256> gamma8{};   // luminance -> brightness
+    std::array<uint16_t, 256> levels{};  // brightness -> level << 8 | fraction
+};
+
+}
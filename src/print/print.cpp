@@ -7,8 +7,18 @@
 
 #include "print.hpp"
 
-#include <ranges>
-#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <cerrno>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
 
 namespace cu {
 
@@ -17,17 +27,277 @@ BasicPrinter& operator<<(BasicPrinter& pr, std::string_view str) {
     return pr;
 }
 
+FrameWriter::FrameWriter(int fd, size_t reserve) : fd(fd) {
+    pending.reserve(reserve);
+}
+
+FrameWriter::~FrameWriter() {
+    set_nonblocking(false);
+    drain(); // don't lose the tail of the last frame
+}
+
+bool FrameWriter::begin_frame() {
+    if (drain()) return true;
+    ++drops;
+    return false;
+}
+
+void FrameWriter::submit(std::string_view frame) {
+    auto n = write_some(frame);
+    if (n < frame.size()) pending.assign(frame.substr(n));
+}
+
+bool FrameWriter::drain() {
+    if (pending.empty()) return true;
+    pending.erase(0, write_some(pending));
+    return pending.empty();
+}
+
+#ifdef _WIN32
+
+void FrameWriter::set_nonblocking(bool) {} // not supported by the console
+
+size_t FrameWriter::write_some(std::string_view data) {
+    auto n = _write(fd, data.data(), (unsigned)data.size());
+    return n < 0 ? 0 : (size_t)n;
+}
+
+#else
+
+void FrameWriter::set_nonblocking(bool enable) {
+    if (enable == nonblock) return;
+    if (enable) {
+        saved_flags = fcntl(fd, F_GETFL);
+        if (saved_flags < 0 || fcntl(fd, F_SETFL, saved_flags | O_NONBLOCK) < 0) return;
+    } else {
+        fcntl(fd, F_SETFL, saved_flags); // the flags are shared with the shell, restore them
+    }
+    nonblock = enable;
+}
+
+size_t FrameWriter::write_some(std::string_view data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        auto n = ::write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break; // EAGAIN in non-blocking mode, or a real error
+        }
+        done += n;
+        if (nonblock) break; // the rest would most likely block
+    }
+    return done;
+}
+
+#endif
+
+bool FrameWriter::nonblocking() const {
+    return nonblock;
+}
+
+size_t FrameWriter::dropped() const {
+    return drops;
+}
+
+namespace {
+
+// byte length of the utf-8 sequence a lead byte starts, sub-cell glyph modes emit up to 3 bytes per cell
+int utf8_length(char lead) {
+    auto b = (uint8_t)lead;
+    return b < 0x80 ? 1 : b < 0xE0 ? 2 : b < 0xF0 ? 3 : 4;
+}
+
+// byte offset `n` cells after `b`, clamped to the string
+size_t skip_cells(std::string_view str, size_t b, int n) {
+    for (; n > 0 && b < str.size(); n--) b += utf8_length(str[b]);
+    return std::min(b, str.size());
+}
+
+}
+
+Printer::Printer() {
+    out.reserve(1 << 16);
+}
+
 Printer::Printer(const Extent& viewport)
-    : viewport(viewport) {}
+    : viewport(viewport) {
+    out.reserve((viewport.x + 1) * viewport.y + 16);
+}
 
 void Printer::print(std::string_view str) {
-    std::ranges::copy(std::views::iota(0, viewport.y) | std::views::transform([&](auto&& i) {
-        return str.substr(i * viewport.x, viewport.x);
-    }), std::ostream_iterator<std::string_view>{std::cout, "\n"});
+    if (!writer.begin_frame()) return; // the terminal is behind, don't even build the frame
+    out.clear();
+    if (std::exchange(home, false)) out += "\033[H";
+    size_t b = 0;
+    for (int y = 0; y < viewport.y; y++) {
+        auto e = skip_cells(str, b, viewport.x);
+        out += str.substr(b, e - b);
+        out += '\n';
+        b = e;
+    }
+    writer.submit(out);
+}
+
+void Printer::print(std::string_view str, std::span<const Rect> damage) {
+    // rows of dropped frames are carried over
+    stale.resize(viewport.y);
+    for (auto&& r : damage)
+        for (int y = std::max(r.y, 0); y < std::min(r.y + r.h, viewport.y); y++)
+            stale[y] = true;
+    if (!writer.begin_frame()) return;
+
+    out.clear();
+    size_t b = 0; // rows are walked by cell, they may differ in bytes
+    for (int y = 0; y < viewport.y; y++) {
+        auto e = skip_cells(str, b, viewport.x);
+        if (stale[y]) {
+            out += "\033[" + std::to_string(y + 1) + ";1H";
+            out += str.substr(b, e - b);
+            stale[y] = false;
+        }
+        b = e;
+    }
+    out += "\033[" + std::to_string(viewport.y + 1) + ";1H";
+    home = false;
+    writer.submit(out);
+}
+
+void Printer::print(std::span<const Cell> cells) {
+    if (!writer.begin_frame()) return;
+    out.clear();
+    if (std::exchange(home, false)) out += "\033[H";
+    SgrEncoder sgr{color_mode};
+    for (int y = 0; y < std::min<int>(viewport.y, (int)cells.size() / viewport.x); y++) {
+        for (int x = 0; x < viewport.x; x++)
+            sgr.append(out, sgr.encode(cells[x + y * viewport.x]));
+        sgr.reset(out); // keep the background from bleeding into the line break
+        out += '\n';
+    }
+    writer.submit(out);
 }
 
 void Printer::clear() {
-    std::cout << "\033[H";
+    home = true;
+}
+
+DeltaPrinter::DeltaPrinter() {
+    out.reserve(1 << 16);
+}
+
+DeltaPrinter::DeltaPrinter(const Extent& viewport, int max_gap)
+    : viewport(viewport), max_gap(max_gap) {
+    out.reserve((viewport.x + 1) * viewport.y + 16);
+}
+
+namespace {
+
+void move_cursor(std::string& out, int y, int x) {
+    out += "\033[";
+    out += std::to_string(y + 1);
+    out += ';';
+    out += std::to_string(x + 1);
+    out += 'H';
+}
+
+// calls emit(y, b, e) for every run of changed cells, rewriting unchanged gaps
+// is cheaper than moving the cursor when they are at most max_gap long
+template <class T, class F>
+void diff_runs(const T* cur, const T* old, int w, int h, int max_gap, F&& emit) {
+    for (int y = 0; y < h; y++) {
+        auto c = cur + y * w, o = old + y * w;
+        for (int x = 0; x < w;) {
+            if (c[x] == o[x]) {
+                ++x;
+                continue;
+            }
+            int b = x, e = x + 1;
+            for (int i = e; i < w && i - e <= max_gap; i++)
+                if (c[i] != o[i]) e = i + 1;
+            emit(y, b, e);
+            x = e;
+        }
+    }
+}
+
+}
+
+void DeltaPrinter::print(std::string_view str) {
+    // a dropped frame leaves prev as is, the next delta then covers both
+    if (!writer.begin_frame()) return;
+    auto [w, h] = viewport.asArray;
+    out.clear();
+    prev_codes.clear();
+
+    // cells are diffed as utf-8 packed glyphs, as Cell does, so sub-cell glyph modes diff per cell too
+    glyphs.clear();
+    for (size_t i = 0; i < str.size();) {
+        auto n = std::min<size_t>(utf8_length(str[i]), str.size() - i);
+        uint32_t g = 0;
+        for (size_t k = 0; k < n; k++) g |= (uint32_t)(uint8_t)str[i + k] << 8 * k;
+        glyphs.push_back(g);
+        i += n;
+    }
+    auto append = [&](uint32_t g) {
+        for (; g; g >>= 8) out += char(g & 255);
+    };
+
+    // a frame of another size is redrawn as a whole
+    if (glyphs.size() != (size_t)(w * h) || prev.size() != glyphs.size()) {
+        out += "\033[H";
+        for (int y = 0; y * w < (int)glyphs.size() && y < h; y++) {
+            if (y) out += '\n';
+            for (int x = 0; x < w && y * w + x < (int)glyphs.size(); x++) append(glyphs[y * w + x]);
+        }
+    } else {
+        int cx = -1, cy = -1; // cursor position, unknown at first
+        diff_runs(glyphs.data(), prev.data(), w, h, max_gap, [&](int y, int b, int e) {
+            if (cx != b || cy != y) move_cursor(out, y, b);
+            for (int x = b; x < e; x++) append(glyphs[y * w + x]);
+            cx = e, cy = y;
+        });
+    }
+    std::swap(prev, glyphs);
+
+    if (!out.empty()) writer.submit(out);
+}
+
+void DeltaPrinter::print(std::span<const Cell> cells) {
+    if (!writer.begin_frame()) return;
+    auto [w, h] = viewport.asArray;
+    out.clear();
+    prev.clear();
+
+    // cells are compared as the terminal shows them, so colors falling into the same palette entry are no change
+    SgrEncoder sgr{color_mode};
+    codes.resize(cells.size());
+    for (size_t i = 0; i < cells.size(); i++)
+        codes[i] = sgr.encode(cells[i]);
+
+    if (codes.size() != (size_t)(w * h) || prev_codes.size() != codes.size()) {
+        out += "\033[H";
+        for (int y = 0; y < std::min<int>(h, (int)codes.size() / w); y++) {
+            if (y) out += '\n';
+            for (int x = 0; x < w; x++) sgr.append(out, codes[y * w + x]);
+        }
+    } else {
+        int cx = -1, cy = -1;
+        diff_runs(codes.data(), prev_codes.data(), w, h, max_gap, [&](int y, int b, int e) {
+            if (cx != b || cy != y) move_cursor(out, y, b);
+            for (int x = b; x < e; x++) sgr.append(out, codes[y * w + x]);
+            cx = e, cy = y;
+        });
+    }
+    sgr.reset(out);
+    std::swap(prev_codes, codes);
+
+    if (!out.empty()) writer.submit(out);
+}
+
+void DeltaPrinter::clear() {}
+
+void DeltaPrinter::invalidate() {
+    prev.clear();
+    prev_codes.clear();
 }
 
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "core.hpp"
+#include "cell.hpp"
 
 namespace cu {
 
@@ -21,14 +22,86 @@ struct BasicPrinter {
 
 BasicPrinter& operator<<(BasicPrinter& pr, std::string_view str);
 
+// hands whole frames to a file descriptor with a single write
+// in non-blocking mode a slow terminal never stalls the caller, the unwritten tail
+// of the last frame is kept and new frames are refused until it drained
+class FrameWriter {
+public:
+    explicit FrameWriter(int fd = 1, size_t reserve = 1 << 16);
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // drains what is left of the last frame, false when the new frame has to be dropped
+    bool begin_frame();
+    // the frame must have been begun
+    void submit(std::string_view frame);
+
+    void set_nonblocking(bool enable);
+    [[nodiscard]] bool nonblocking() const;
+    [[nodiscard]] size_t dropped() const;
+
+private:
+    bool drain();
+    // writes as much as possible, returns the number of bytes written
+    size_t write_some(std::string_view data);
+
+    int fd;
+    bool nonblock = false;
+    int saved_flags = -1;
+    size_t drops = 0;
+    std::string pending;
+};
+
 struct Printer : public BasicPrinter {
-    Printer() = default;
+    Printer();
     Printer(const Extent& viewport);
 
+    // rows are split by cell, the utf-8 of sub-cell glyph modes may take several bytes per cell
     void print(std::string_view str) override;
-    void clear() override;
+    void clear() override; // homes the cursor with the next frame
+
+    // rewrites only the rows touched by `damage` (in cells) in place
+    void print(std::string_view str, std::span<const Rect> damage);
+    // colored cells, consecutive cells of the same color share one SGR sequence
+    void print(std::span<const Cell> cells);
 
     Extent viewport{80, 22}; // nothing special
+    ColorMode color_mode = ColorMode::truecolor;
+    FrameWriter writer;
+
+private:
+    bool home = false;
+    std::vector<bool> stale;
+    std::string out;
+};
+
+// keeps the last frame and only emits the cells that changed
+struct DeltaPrinter : public BasicPrinter {
+    DeltaPrinter();
+    DeltaPrinter(const Extent& viewport, int max_gap = 6);
+
+    // diffed per cell, utf-8 glyphs of sub-cell modes included
+    void print(std::string_view str) override;
+    void clear() override; // cursor is addressed absolutely, nothing to do
+
+    // colored cells, consecutive cells of the same color share one SGR sequence
+    void print(std::span<const Cell> cells);
+
+    void invalidate(); // the next frame is fully redrawn
+
+    Extent viewport{80, 22};
+    // unchanged cells between two changed runs on a row are rewritten
+    // instead of moving the cursor when there are at most this many of them
+    int max_gap = 6;
+    ColorMode color_mode = ColorMode::truecolor;
+    FrameWriter writer; // dropped frames are merged into the next delta
+
+private:
+    std::vector<uint32_t> prev, glyphs; // utf-8 packed, one per cell
+    std::vector<CellCode> prev_codes, codes;
+    std::string out;
 };
 
 }